@@ -0,0 +1,225 @@
+// Hand held jog wheel: a quadrature encoder whose speed comes from
+// tilting the Free-Wili. Level is stopped, tilting left or right runs
+// the encoder backwards or forwards, faster the more it is tilted.
+// Same pins as quadrature.cpp, so it drops in where the simulator was.
+
+#include "fwwasm.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// 13 -> 1 and 27 -> 3 in the pin numbers on the outside
+#define PinA 13
+#define PinB 27
+
+// Quadrature states in forwards order, pinA is the first index
+const int nextStateTable[][2] = {{0,0},{1,0},{1,1},{0,1}};
+int nextStateIndex = 0;
+int transitionCount = 0;
+
+// How often the accelerometer sends a sample, in ms
+// Every sample is a speed update, so this is also the jog latency
+const int ACCEL_RATE_MS = 20;
+
+// The tilt comes in as the X acceleration in mg: 1000 * sin(angle), so no
+// trig is needed to get from the sample to the curve
+// Transfer curve from tilt to speed (edges/s), one point every
+// CURVE_STEP_MG, straight lines in between. Flat around level so a
+// shaky hand doesn't creep, steep near 90 degrees for fast moves.
+const int32_t CURVE_STEP_MG = 125;
+constexpr std::array<int32_t, 9> SPEED_CURVE{0, 0, 8, 30, 80, 170, 320, 580, 1000};
+const int32_t MAX_TILT_MG = CURVE_STEP_MG * (static_cast<int32_t>(SPEED_CURVE.size()) - 1);
+// The loop makes at most one edge per 1ms (see run_encoder), so the gain
+// stops where the top of the curve gets there
+const int32_t MAX_EDGES_PER_SECOND = 1000;
+const int32_t MAX_GAIN_QUARTERS = 4 * MAX_EDGES_PER_SECOND / SPEED_CURVE.back();
+
+// Signed speed in edges/s, only changed when a sample comes in
+int32_t speed = 0;
+int32_t tiltMg = 0;
+// Sensitivity in 1/4: the curve's speeds are scaled by it
+int32_t gainQuarters = 4;
+bool running = true;
+
+// Thousandths of an edge made but not yet put out
+uint32_t phase = 0;
+unsigned int lastStepMs = 0;
+
+// GUI
+const int panelIndex = 0;
+enum guiIndexes {tickTextIndex,
+                 tickNumberIndex,
+                 tiltTextIndex,
+                 tiltNumberIndex,
+                 speedTextIndex,
+                 speedNumberIndex,
+                 gainTextIndex,
+                 gainNumberIndex,
+                 runTextIndex,
+                 runNumberIndex};
+// The tick count doesn't need to be shown on every loop
+const unsigned int GUI_PERIOD_MS = 50;
+unsigned int guiOldMillis = 0;
+
+// Speed for a tilt, piecewise linear between the curve's points
+// Integer only, it runs for every sample
+auto tilt_to_speed(int32_t mg) -> int32_t {
+    const int32_t magnitude = std::min(mg < 0 ? -mg : mg, MAX_TILT_MG);
+    const auto point = static_cast<size_t>(magnitude / CURVE_STEP_MG);
+    const int32_t fraction = magnitude % CURVE_STEP_MG;
+    int32_t value = SPEED_CURVE[point];
+    if (point + 1 < SPEED_CURVE.size()) {
+        value += (SPEED_CURVE[point + 1] - value) * fraction / CURVE_STEP_MG;
+    }
+    value = value * gainQuarters / 4;
+    return mg < 0 ? -value : value;
+}
+
+// Little endian 32 bit int at "data"
+auto read_int32(const uint8_t* data) -> int32_t {
+    return static_cast<int32_t>(static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8
+                                | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24);
+}
+
+// The sensor event is taken to hold X, Y and Z as little endian 32 bit
+// ints in mg, then the temperatures. fwwasm.h doesn't say, and
+// getEventData() doesn't give the length, so the sample has to look like
+// a hand held board: every axis inside the sensor's 16g and the three
+// together somewhere between 1/2g and 2g. Only X is used.
+// Returns false (and leaves "mg" alone) for anything else.
+auto read_tilt(const uint8_t* data, int32_t& mg) -> bool {
+    int64_t magnitudeSquared = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        const int32_t value = read_int32(data + 4 * axis);
+        if (value < -16000 || value > 16000) {
+            return false;
+        }
+        magnitudeSquared += static_cast<int64_t>(value) * value;
+    }
+    if (magnitudeSquared < 500 * 500 || magnitudeSquared > 2000 * 2000) {
+        return false;
+    }
+    mg = read_int32(data);
+    return true;
+}
+
+// One edge forwards or backwards
+auto quadratureNextTick(bool forwards) -> void {
+    nextStateIndex = (nextStateIndex + (forwards ? 1 : 3)) % 4;
+    transitionCount += forwards ? 1 : -1;
+    setIO(PinA, nextStateTable[nextStateIndex][0]);
+    setIO(PinB, nextStateTable[nextStateIndex][1]);
+}
+
+// Puts out the edges the speed asks for since the last call
+// The speed is a phase increment per ms, so the loop does the same small
+// sum whatever the speed, and an edge is one more compare
+auto run_encoder(unsigned int nowMs) -> void {
+    // A long stall (dialog, slow host call) doesn't come out as a burst
+    const uint32_t elapsedMs = std::min(nowMs - lastStepMs, 10u);
+    lastStepMs = nowMs;
+    if (!running || speed == 0) {
+        phase = 0;
+        return;
+    }
+    phase += static_cast<uint32_t>(speed < 0 ? -speed : speed) * elapsedMs;
+    // At most one edge per loop, the loop is 1ms and the curve tops out at
+    // 1000 edges/s, anything more is dropped rather than run together
+    if (phase >= 1000) {
+        phase = std::min(phase - 1000, 999u);
+        quadratureNextTick(speed > 0);
+    }
+}
+
+auto show_speed() -> void {
+    setControlValue(panelIndex,tiltNumberIndex,tiltMg);
+    setControlValue(panelIndex,speedNumberIndex,speed);
+}
+
+auto setup_panel() -> void {
+    addPanel(panelIndex, 1, 0, 0, 0, 0, 0, 0, 1);
+    // Clear the event lists
+    uint8_t event_data[FW_GET_EVENT_DATA_MAX] = {0};
+    getEventData(event_data);
+    setPanelMenuText(panelIndex,0,"Zero");
+    setPanelMenuText(panelIndex,1,"Gain");
+    setPanelMenuText(panelIndex,2,"Hold");
+    setPanelMenuText(panelIndex,3,"");
+    setPanelMenuText(panelIndex,4,"Exit");
+
+    const char* const labels[] = {"Tick #:", "Tilt mg:", "Edges/s:", "Gain/4:", "Run:"};
+    for (int row = 0; row < 5; row++) {
+        addControlText(panelIndex,tickTextIndex+row*2,
+                       3, 30+row*25, 1, 64,
+                       255, 255, 255, labels[row]);
+        addControlNumber(panelIndex,tickNumberIndex+row*2,1,
+                        125,28+row*25,10,1,1,
+                        0,255,0,0,0,0,0);
+    }
+    setControlValue(panelIndex,tickNumberIndex,transitionCount);
+    show_speed();
+    setControlValue(panelIndex,gainNumberIndex,gainQuarters);
+    setControlValue(panelIndex,runNumberIndex,running);
+}
+
+auto process_events() -> void {
+    setIO(PinA,0);
+    setIO(PinB,0);
+    // Stream only the accelerometer, no plots
+    setSensorSettings(1, 0, ACCEL_RATE_MS, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    lastStepMs = millis();
+
+    while (true) {
+        waitms(1);
+        const unsigned int nowMs = millis();
+        run_encoder(nowMs);
+
+        if (nowMs - guiOldMillis >= GUI_PERIOD_MS) {
+            guiOldMillis = nowMs;
+            setControlValue(panelIndex,tickNumberIndex,transitionCount);
+        }
+
+        // Take every waiting event, a sample shouldn't sit behind another
+        // one for a whole loop
+        while (hasEvent() != 0) {
+            uint8_t event_data[FW_GET_EVENT_DATA_MAX] = {0};
+            const int last_event = getEventData(event_data);
+            switch (last_event) {
+            case FWGUI_EVENT_GUI_SENSOR_DATA:
+                // A sample that doesn't make sense stops the wheel rather
+                // than keep it going on an old one
+                if (read_tilt(event_data, tiltMg)) {
+                    speed = tilt_to_speed(tiltMg);
+                } else {
+                    speed = 0;
+                }
+                show_speed();
+                break;
+            case FWGUI_EVENT_GRAY_BUTTON:
+                transitionCount = 0;
+                setControlValue(panelIndex,tickNumberIndex,transitionCount);
+                break;
+            case FWGUI_EVENT_YELLOW_BUTTON:
+                // 1/4, 1/2 and 1 times the curve, up to MAX_GAIN_QUARTERS
+                gainQuarters = gainQuarters * 2 > MAX_GAIN_QUARTERS ? 1 : gainQuarters * 2;
+                setControlValue(panelIndex,gainNumberIndex,gainQuarters);
+                break;
+            case FWGUI_EVENT_GREEN_BUTTON:
+                running = !running;
+                setControlValue(panelIndex,runNumberIndex,running);
+                break;
+            case FWGUI_EVENT_RED_BUTTON:
+                setSensorSettings(0, 0, ACCEL_RATE_MS, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+                return;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+auto main() -> int {
+    setup_panel();
+    process_events();
+    return 0;
+}
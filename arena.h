@@ -0,0 +1,91 @@
+// Single static arena for every large buffer in the app
+//
+// The Free-Wili gives us one 64KB page of memory and the stack takes
+// 61440 bytes of it (see the linker flags in CMakeLists.txt), leaving
+// 4KB for every global we have. Large buffers are not declared as loose
+// globals, instead each component declares how many bytes it needs as a
+// constexpr budget, and the app adds them up with arenaTotal() and checks
+// the total with a static_assert. If something no longer fits the build
+// breaks, instead of the buffers silently running into each other.
+// The compiler can't see the rest of the static data, so once the module
+// is linked cmake/check_static_memory.cmake checks the whole of it, and
+// fails the build if it runs past the 64KB.
+//
+// Nothing here uses the heap, objects are constructed in place once at
+// startup and live forever.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Must match the linker flags in CMakeLists.txt
+constexpr size_t MEMORY_BYTES = 65536; // --initial-memory
+constexpr size_t STACK_BYTES = 61440; // -z stack-size, placed first
+// Everything that isn't stack
+constexpr size_t STATIC_BYTES = MEMORY_BYTES - STACK_BYTES;
+// Kept for everything static that lives outside the arena: the small
+// globals (engine state, GUI, UART line buffers...), constant tables and
+// string literals. quadrature.cpp has about 1.5KB of them laid out for
+// wasm32, the post link check is what holds them to it. Whatever the
+// arena doesn't use is the margin for both.
+constexpr size_t GLOBALS_RESERVE = 1536;
+constexpr size_t ARENA_CAPACITY = STATIC_BYTES - GLOBALS_RESERVE;
+
+// Every allocation is rounded up so the next one stays 16 byte aligned
+// (coroutine frames need as much as the heap would give them)
+constexpr size_t ARENA_ALIGNMENT = 16;
+constexpr auto arenaAlign(size_t bytes) -> size_t {
+    return (bytes + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+// Adds up the component budgets the same way the arena hands them out
+template <size_t... Budgets>
+constexpr auto arenaTotal() -> size_t {
+    return (arenaAlign(Budgets) + ... + 0);
+}
+
+template <size_t Bytes>
+class StaticArena {
+public:
+    // Constructs a T in the arena, only call this at startup
+    // Running out means a component was not added to the budget,
+    // which is a bug, so stop right there
+    template <typename T>
+    auto make() -> T& {
+        static_assert(alignof(T) <= ARENA_ALIGNMENT, "arena alignment is too small for this type");
+        if (used + sizeof(T) > Bytes) {
+            __builtin_trap();
+        }
+        T* object = new (storage + used) T{};
+        used += arenaAlign(sizeof(T));
+        return *object;
+    }
+
+    auto usedBytes() const -> size_t {
+        return used;
+    }
+
+    static constexpr auto capacity() -> size_t {
+        return Bytes;
+    }
+
+private:
+    alignas(ARENA_ALIGNMENT) unsigned char storage[Bytes] = {};
+    size_t used = 0;
+};
+
+#ifdef __wasm__
+// Provided by the linker: first byte after all the static data
+extern "C" unsigned char __heap_base;
+
+// Bytes of static data (globals + arena) actually in the module
+inline auto staticBytesUsed() -> size_t {
+    return reinterpret_cast<size_t>(&__heap_base) - STACK_BYTES;
+}
+#else
+// Host builds have no such layout
+inline auto staticBytesUsed() -> size_t {
+    return 0;
+}
+#endif
@@ -0,0 +1,104 @@
+// Results of a count error vs frequency characterization run
+//
+// The run itself is a sequence in quadrature.cpp: for every rate it moves
+// a fixed number of counts forwards and back again, and reads the device
+// under test's count at both ends. This keeps the table of what came out
+// and works out the highest rate the DUT counted correctly at.
+
+#pragma once
+
+#include "text_line.h"
+#include <cstddef>
+#include <cstdint>
+
+// How a step failed, from the DUT's error at the far end of the forward
+// move and after coming back
+enum class CountFailure : char {
+    none = 'o', // both ends right
+    missed = 'm', // counted short going forwards, too slow for us
+    extra = 'x', // counted too many going forwards, noise or bounce
+    direction = 'd', // right going forwards but not coming back
+    noReadback = '?', // the DUT never answered
+};
+
+struct CharacterizationStep {
+    uint16_t rateMs = 0; // commanded 1/4 period
+    uint16_t achievedEdgesPerSecond = 0; // what the engine really did
+    int16_t forwardError = 0; // DUT minus us at the far end
+    int16_t netError = 0; // DUT minus us after coming back
+    CountFailure failure = CountFailure::none;
+};
+
+struct CharacterizationTable {
+    static constexpr auto MAX_STEPS = 16;
+
+    CharacterizationStep steps[MAX_STEPS] = {};
+    uint8_t count = 0;
+
+    auto clear() -> void {
+        count = 0;
+    }
+
+    auto add(uint16_t rateMs, uint16_t achieved, int32_t forwardError, int32_t netError, bool readback) -> CharacterizationStep& {
+        CharacterizationStep& step = steps[count < MAX_STEPS ? count++ : MAX_STEPS - 1];
+        step.rateMs = rateMs;
+        step.achievedEdgesPerSecond = achieved;
+        step.forwardError = static_cast<int16_t>(forwardError);
+        step.netError = static_cast<int16_t>(netError);
+        if (!readback) {
+            step.failure = CountFailure::noReadback;
+        } else if (forwardError < 0) {
+            step.failure = CountFailure::missed;
+        } else if (forwardError > 0) {
+            step.failure = CountFailure::extra;
+        } else if (netError != 0) {
+            step.failure = CountFailure::direction;
+        } else {
+            step.failure = CountFailure::none;
+        }
+        return step;
+    }
+
+    // Highest achieved rate (edges/s) that was counted right, with every
+    // slower step right too. 0 if even the slowest step failed.
+    auto maxReliableEdgesPerSecond() const -> uint16_t {
+        uint16_t best = 0;
+        for (int i = 0; i < count; i++) {
+            if (steps[i].failure != CountFailure::none) {
+                break;
+            }
+            best = steps[i].achievedEdgesPerSecond > best ? steps[i].achievedEdgesPerSecond : best;
+        }
+        return best;
+    }
+
+    // What went wrong at the first step that failed
+    auto signature() const -> CountFailure {
+        for (int i = 0; i < count; i++) {
+            if (steps[i].failure != CountFailure::none) {
+                return steps[i].failure;
+            }
+        }
+        return CountFailure::none;
+    }
+
+    // Appends the table to an open file, one line per step:
+    //   "C <ms> <counts per move>"  once, when the run started
+    //   "S <rate ms> <edges/s> <forward error> <net error> <failure>"
+    //   "F <max reliable edges/s> <failure signature>"  at the end
+    auto write(int handle, uint32_t startedMs, int32_t counts) const -> void {
+        TextLine line;
+        line.put('C').putInt(startedMs).putInt(counts).writeFile(handle);
+        for (int i = 0; i < count; i++) {
+            const CharacterizationStep& step = steps[i];
+            const char failure[2] = {static_cast<char>(step.failure), '\0'};
+            line.put('S').putInt(step.rateMs).putInt(step.achievedEdgesPerSecond)
+                .putInt(step.forwardError).putInt(step.netError).putWord(failure).writeFile(handle);
+        }
+        const char failure[2] = {static_cast<char>(signature()), '\0'};
+        line.put('F').putInt(maxReliableEdgesPerSecond()).putWord(failure).writeFile(handle);
+    }
+};
+
+// Memory the table takes in the app arena (see arena.h)
+constexpr size_t CHARACTERIZATION_ARENA_BYTES = sizeof(CharacterizationTable);
@@ -0,0 +1,152 @@
+# Post link check of a .wasm module's memory layout
+#
+# The stack goes first (--stack-first), then the static data (globals,
+# the arena, constants and string literals), and all of it has to fit in
+# the one 64KB page the Free-Wili gives us. The compiler can only check
+# the arena (see arena.h), this checks the real thing: the __data_end and
+# __heap_base globals the linker put in the module.
+#
+#   cmake -DWASM=<module> -DMEMORY_BYTES=<bytes> -DSTACK_BYTES=<bytes> -P check_static_memory.cmake
+#
+# Fails if the static data runs past MEMORY_BYTES, otherwise prints how
+# much of it there is and how much is left.
+
+cmake_minimum_required(VERSION 3.25)
+
+file(READ "${WASM}" hex HEX)
+string(LENGTH "${hex}" hexLength)
+math(EXPR size "${hexLength} / 2")
+
+# Reads the byte at "offset" into "out"
+macro(read_byte out)
+    math(EXPR _hexAt "${offset} * 2")
+    string(SUBSTRING "${hex}" ${_hexAt} 2 _byte)
+    math(EXPR ${out} "0x${_byte}")
+    math(EXPR offset "${offset} + 1")
+endmacro()
+
+# Reads an unsigned LEB128 number at "offset" into "out"
+macro(read_leb out)
+    set(${out} 0)
+    set(_shift 0)
+    while(TRUE)
+        read_byte(_part)
+        math(EXPR ${out} "${${out}} + ((${_part} & 127) << ${_shift})")
+        math(EXPR _shift "${_shift} + 7")
+        if(_part LESS 128)
+            break()
+        endif()
+    endwhile()
+endmacro()
+
+# Reads a length prefixed name at "offset" into "out"
+macro(read_name out)
+    read_leb(_nameLength)
+    math(EXPR _hexAt "${offset} * 2")
+    math(EXPR _hexLength "${_nameLength} * 2")
+    string(SUBSTRING "${hex}" ${_hexAt} ${_hexLength} ${out})
+    math(EXPR offset "${offset} + ${_nameLength}")
+endmacro()
+
+# Skips a table or memory limits
+macro(skip_limits)
+    read_byte(_flags)
+    read_leb(_minimum)
+    if(_flags EQUAL 1)
+        read_leb(_maximum)
+    endif()
+endmacro()
+
+# Names as hex, that's how read_name gives them back
+set(HEAP_BASE_NAME "5f5f686561705f62617365") # __heap_base
+set(DATA_END_NAME "5f5f646174615f656e64") # __data_end
+
+set(importedGlobals 0)
+set(globalValues "")
+set(offset 8) # magic and version
+while(offset LESS size)
+    read_byte(section)
+    read_leb(sectionSize)
+    math(EXPR sectionEnd "${offset} + ${sectionSize}")
+    if(section EQUAL 2)
+        # Imports, globals imported come first in the global index space
+        read_leb(count)
+        if(count GREATER 0)
+            foreach(i RANGE 1 ${count})
+                read_name(module)
+                read_name(field)
+                read_byte(kind)
+                if(kind EQUAL 0)
+                    read_leb(type)
+                elseif(kind EQUAL 1)
+                    read_byte(refType)
+                    skip_limits()
+                elseif(kind EQUAL 2)
+                    skip_limits()
+                elseif(kind EQUAL 3)
+                    read_byte(valueType)
+                    read_byte(mutable)
+                    math(EXPR importedGlobals "${importedGlobals} + 1")
+                else()
+                    read_byte(attribute)
+                    read_leb(type)
+                endif()
+            endforeach()
+        endif()
+    elseif(section EQUAL 6)
+        # Globals, only the i32.const ones matter here, the addresses
+        read_leb(count)
+        if(count GREATER 0)
+            foreach(i RANGE 1 ${count})
+                read_byte(valueType)
+                read_byte(mutable)
+                read_byte(opcode)
+                set(value -1)
+                if(opcode EQUAL 65) # i32.const, the addresses are all positive
+                    read_leb(value)
+                endif()
+                list(APPEND globalValues ${value})
+                # Whatever else is in the init expression, up to its end
+                while(TRUE)
+                    read_byte(opcode)
+                    if(opcode EQUAL 11)
+                        break()
+                    endif()
+                endwhile()
+            endforeach()
+        endif()
+    elseif(section EQUAL 7)
+        # Exports, --export-all puts the linker's globals in here
+        read_leb(count)
+        if(count GREATER 0)
+            foreach(i RANGE 1 ${count})
+                read_name(name)
+                read_byte(kind)
+                read_leb(index)
+                if(kind EQUAL 3 AND (name STREQUAL HEAP_BASE_NAME OR name STREQUAL DATA_END_NAME))
+                    math(EXPR local "${index} - ${importedGlobals}")
+                    list(GET globalValues ${local} value)
+                    if(name STREQUAL HEAP_BASE_NAME)
+                        set(heapBase ${value})
+                    else()
+                        set(dataEnd ${value})
+                    endif()
+                endif()
+            endforeach()
+        endif()
+    endif()
+    set(offset ${sectionEnd})
+endwhile()
+
+get_filename_component(module "${WASM}" NAME)
+if(NOT DEFINED heapBase OR NOT DEFINED dataEnd)
+    message(FATAL_ERROR "${module}: no __heap_base/__data_end exports, can't check its memory (link with --export-all)")
+endif()
+math(EXPR staticBytes "${dataEnd} - ${STACK_BYTES}")
+math(EXPR staticLimit "${MEMORY_BYTES} - ${STACK_BYTES}")
+if(heapBase GREATER MEMORY_BYTES OR dataEnd GREATER MEMORY_BYTES)
+    message(FATAL_ERROR "${module}: static data is ${staticBytes} bytes, only ${staticLimit} fit next to the stack "
+                        "(__data_end ${dataEnd}, __heap_base ${heapBase}, memory ${MEMORY_BYTES})")
+endif()
+math(EXPR left "${MEMORY_BYTES} - ${heapBase}")
+message(STATUS "${module}: ${staticBytes} of ${staticLimit} bytes of static data, ${left} left")
@@ -0,0 +1,230 @@
+// Reads the position counter of the device under test (DUT) and compares
+// it with ours, so a miscount is caught the moment it happens instead of
+// at the end of a run.
+//
+// The DUT counter can be read three ways:
+//  - UART: we send "?" and the DUT answers with its count as a decimal line
+//  - I2C: i2cRead of a register, little endian
+//  - SPI: SPIReadWrite of a command byte followed by the count, big endian
+// The DUT may count every edge (x4 decoding), every other edge (x2) or
+// once per cycle (x1), set with edgesPerCount. Its counter may be narrower
+// than ours, so the comparison is done modulo its width. Whatever it reads
+// on the first read is taken as our zero.
+//
+// Reads only happen when there is enough time before the next edge
+// (see quadrature.cpp), so the pins never wait on a readback, and the
+// count we compare against can't change during an I2C or SPI read. A UART
+// answer can come back after some edges; any value between our count when
+// we asked and our count when it arrived is accepted.
+//
+// There is only the one UART. With the UART link it belongs to the DUT:
+// no telemetry or pings go out and the only thing taken from it, other
+// than the DUT's answers, is a "D" line to hand it back to the PC.
+
+#pragma once
+
+#include "fwwasm.h"
+#include "text_line.h"
+#include "uart_link.h"
+#include <cstddef>
+#include <cstdint>
+
+enum class DutLink : uint8_t { none, uart, i2c, spi };
+
+struct DutReadback {
+    DutLink link = DutLink::none;
+    int i2cAddress = 0x40;
+    int i2cRegister = 0;
+    unsigned char spiCommand = 0x01;
+    int counterBytes = 4; // 1 to 4
+    int edgesPerCount = 1; // 1 (x4), 2 (x2) or 4 (x1)
+    uint32_t periodMs = 100; // time between reads
+    // A UART answer that takes longer than this is given up on
+    uint32_t uartTimeoutMs = 50;
+
+    uint32_t nextReadMs = 0;
+    bool uartWaiting = false;
+    uint32_t uartAskedMs = 0;
+    int32_t uartAskedPosition = 0;
+
+    bool aligned = false;
+    int32_t offset = 0; // DUT count minus ours at the first read
+    int32_t lastCount = 0; // last DUT count, raw
+    int32_t difference = 0; // DUT minus us, in DUT counts
+    bool diverged = false;
+    uint32_t firstDivergenceMs = 0;
+    uint32_t reads = 0;
+    uint32_t failures = 0;
+
+    // Forget the alignment and any divergence, e.g. after a reset
+    auto restart() -> void {
+        aligned = false;
+        difference = 0;
+        diverged = false;
+        firstDivergenceMs = 0;
+        uartWaiting = false;
+    }
+
+    // From now on the DUT's count has to be exactly ours, e.g. after
+    // homing, when both should have zeroed at the same place
+    auto expectSameCount() -> void {
+        restart();
+        aligned = true;
+        offset = 0;
+    }
+
+    auto due(uint32_t nowMs) const -> bool {
+        return link != DutLink::none && !uartWaiting && static_cast<int32_t>(nowMs - nextReadMs) >= 0;
+    }
+
+    // Reads the DUT now. For I2C and SPI the answer is compared straight
+    // away, for the UART the question is sent and handleLine() does the rest.
+    // Returns true if the difference changed.
+    auto read(uint32_t nowMs, int32_t position) -> bool {
+        nextReadMs = nowMs + periodMs;
+        if (link == DutLink::uart) {
+            TextLine query;
+            query.put('?').sendUart();
+            uartWaiting = true;
+            uartAskedMs = nowMs;
+            uartAskedPosition = position;
+            return false;
+        }
+        unsigned char raw[5] = {0};
+        int32_t count = 0;
+        if (link == DutLink::i2c) {
+            if (i2cRead(i2cAddress, i2cRegister, raw, counterBytes) == 0) {
+                failures++;
+                return false;
+            }
+            for (int i = counterBytes - 1; i >= 0; i--) {
+                count = static_cast<int32_t>((static_cast<uint32_t>(count) << 8) | raw[i]);
+            }
+        } else {
+            unsigned char out[5] = {spiCommand, 0, 0, 0, 0};
+            if (SPIReadWrite(out, counterBytes + 1, raw) == 0) {
+                failures++;
+                return false;
+            }
+            for (int i = 1; i <= counterBytes; i++) {
+                count = static_cast<int32_t>((static_cast<uint32_t>(count) << 8) | raw[i]);
+            }
+        }
+        return compare(count, position, position, nowMs);
+    }
+
+    // Takes the DUT's answer from the UART, a line that is just a number
+    // Returns true if it was one
+    auto handleLine(const char* line, int32_t position, uint32_t nowMs, bool& changed) -> bool {
+        changed = false;
+        if (link != DutLink::uart || !uartWaiting || !((line[0] >= '0' && line[0] <= '9') || line[0] == '-')) {
+            return false;
+        }
+        const char* cursor = line;
+        int64_t count = 0;
+        uartWaiting = false;
+        if (!parseInt(cursor, count)) {
+            failures++;
+            return true;
+        }
+        changed = compare(static_cast<int32_t>(count), uartAskedPosition, position, nowMs);
+        return true;
+    }
+
+    // Gives up on a UART answer that never came
+    auto checkTimeout(uint32_t nowMs) -> void {
+        if (uartWaiting && nowMs - uartAskedMs > uartTimeoutMs) {
+            uartWaiting = false;
+            failures++;
+        }
+    }
+
+    // Compares a raw DUT count against our position, which was somewhere
+    // between "from" and "to" while the DUT was being read
+    auto compare(int32_t count, int32_t from, int32_t to, uint32_t nowMs) -> bool {
+        reads++;
+        lastCount = count;
+        const int32_t low = scaled(from < to ? from : to);
+        const int32_t high = scaled(from < to ? to : from);
+        if (!aligned) {
+            aligned = true;
+            offset = minus(count, low);
+            return false;
+        }
+        const int32_t relative = minus(count, offset);
+        int32_t newDifference = 0;
+        if (minus(relative, low) < 0) {
+            newDifference = minus(relative, low);
+        } else if (minus(relative, high) > 0) {
+            newDifference = minus(relative, high);
+        }
+        if (newDifference != 0 && !diverged) {
+            diverged = true;
+            firstDivergenceMs = nowMs;
+        }
+        const bool changed = newDifference != difference;
+        difference = newDifference;
+        return changed;
+    }
+
+private:
+    // Our position in DUT counts
+    auto scaled(int32_t position) const -> int32_t {
+        // Round towards minus infinity so going backwards past zero works
+        return position >= 0 ? position / edgesPerCount : -((-position + edgesPerCount - 1) / edgesPerCount);
+    }
+
+    // a - b, wrapped around to the width of the DUT counter
+    auto minus(int32_t a, int32_t b) const -> int32_t {
+        const uint32_t value = static_cast<uint32_t>(a) - static_cast<uint32_t>(b);
+        const int shift = 32 - 8 * counterBytes;
+        return static_cast<int32_t>(value << shift) >> shift;
+    }
+};
+
+// Lines for the DUT log kept in RAM, so a difference that keeps changing
+// doesn't open and close the file every time. The loop writes them out
+// every so often when there is time between edges, or when they don't fit.
+struct DutLog {
+    static constexpr auto CAPACITY = 192;
+
+    unsigned char buffer[CAPACITY] = {};
+    int length = 0;
+    uint32_t firstMs = 0; // when the oldest line still here was added
+
+    // Takes the line and clears it, false if there is no room for it
+    auto add(TextLine& line, uint32_t nowMs) -> bool {
+        if (length + line.length + 1 > CAPACITY) {
+            return false;
+        }
+        if (length == 0) {
+            firstMs = nowMs;
+        }
+        for (int i = 0; i < line.length; i++) {
+            buffer[length++] = line.buffer[i];
+        }
+        buffer[length++] = '\n';
+        line.length = 0;
+        return true;
+    }
+
+    auto due(uint32_t nowMs, uint32_t periodMs) const -> bool {
+        return length > 0 && nowMs - firstMs >= periodMs;
+    }
+
+    // Appends everything to the file, dropped if it can't be opened
+    auto flush(const char* fileName) -> void {
+        if (length == 0) {
+            return;
+        }
+        const int handle = openFile(fileName, FILE_MODE_APPEND);
+        if (handle >= 0) {
+            writeFile(handle, buffer, length);
+            closeFile(handle);
+        }
+        length = 0;
+    }
+};
+
+// Memory the log takes in the app arena (see arena.h)
+constexpr size_t DUT_LOG_ARENA_BYTES = sizeof(DutLog);
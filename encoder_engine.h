@@ -0,0 +1,154 @@
+// The quadrature encoder itself: the pin states, the counters and when
+// the next edge is due. It makes no host calls, the app writes the pins
+// it hands back, so quadrature.cpp runs one of these and the host tools
+// can run as many side by side as they like, none touching another.
+
+#pragma once
+
+#include <cstdint>
+
+struct QuadratureEngine {
+    // Next state transition table of a quadrature encoder
+    // Representas all the LEGAL states of a qudrature encoder
+    // Encoded as a two dimensional table
+    // The first index is in incremented if the encoder
+    // is moving forward, otherwise it's decremented
+    // pinA is the first index, pinB is the second
+    static constexpr int nextStateTable[][2] = {{0,0},{1,0},{1,1},{0,1}};
+    int nextStateIndex = 0; //Initial state of the sensor
+    int direction = 1; // Direction of the encoder, 1 for increasing, 0 for decreasing
+
+    // How long before the quadrature encoder "pins"
+    // change state
+    // the sensor refresh rate will be the DRIVING variable, as it needs to be a positive WHOLE number
+    // in order for this to work...
+    unsigned int sensorRefreshRate = 10; // in milliseconds
+    // sensor refresh rate is essentially the 1/4 the period of freuency of pinA or pinB
+    // When the next edge is due, same 32 bits as millis() so it wraps
+    // with it every 49.7 days
+    uint32_t sensorOldMillis = 0;
+
+    // Flag to continue simulating or to stop the encoder simulation
+    // Stops the simulation of the quadrature encoder when it is true
+    // By default it starts in the stopped state
+    bool stopSimulation = true;
+
+    // Transition counter, wraps from 2^31-1 to -2^31 (24.8 days at 1ms)
+    // the same way the DUT's 32 bit counter does, so a reader that takes
+    // differences keeps working
+    // Stores the number of transitions that either pinA or pinB has
+    // Every time we update the "encoder" pins this value changes
+    // so the encoder frequency is this number/4.
+    int transitionCount = 0;
+
+    // Temporary counter to determine when
+    // to increment the revolution counter, 4 edges per tooth
+    int revTickThreshold = 100;
+    // Counter to hold number of ticks since last update to the
+    // total revolution counter
+    int revTickCount = 0;
+    int totalRefs = 0; // Stores the total number of revs the sensor has "traveled"
+    // Off when something else counts totalRefs (the linear scale)
+    bool countRevolutions = true;
+
+    // Stores the state of the pins
+    // pinA is index 0, and pinB is index 1
+    int sensorState[2] = {0};
+
+    auto setTeeth(unsigned int teeth) -> void {
+        revTickThreshold = 4*static_cast<int>(teeth);
+        revTickCount = transitionCount % revTickThreshold;
+    }
+
+    // True when the next edge should go out
+    // Compared as a difference: once millis() gets near the wrap the
+    // deadline has already wrapped to a small number, and a plain >=
+    // would put out an edge on every loop until millis() caught up
+    auto due(uint32_t nowMs) const -> bool {
+        return static_cast<int32_t>(nowMs - sensorOldMillis) >= 0 && !stopSimulation;
+    }
+
+    // Adds to the transition count modulo 2^32, no signed overflow
+    auto count(int32_t edges) -> void {
+        transitionCount = static_cast<int>(static_cast<uint32_t>(transitionCount) + static_cast<uint32_t>(edges));
+    }
+
+    // Moves one tick/state, sensorState then has the pins to write
+    // Steps the state index first and then takes the state, so the very
+    // first edge and the first edge after a reversal move the pins the
+    // same way as the counter
+    // forwards: 0 = backwards, 1 = forwards
+    auto step(int forwards) -> void {
+        if(forwards){
+            nextStateIndex++;
+            //Increase the transition counter
+            count(1);
+        }else{
+            nextStateIndex--;
+            count(-1);
+        }
+        if(nextStateIndex>3){
+            nextStateIndex = 0;
+        }
+        if(nextStateIndex<0){
+            nextStateIndex = 3;
+        }
+        sensorState[0]  = nextStateTable[nextStateIndex][0];
+        sensorState[1]  = nextStateTable[nextStateIndex][1];
+
+        // Increment or decrement number of revolutions
+        // The tick count is left alone while something else counts them,
+        // preset() sets it again when it's handed back
+        if(!countRevolutions){
+            return;
+        }
+        revTickCount += forwards ? 1 : -1;
+        if(revTickCount==revTickThreshold||revTickCount==-revTickThreshold){
+            revTickCount=0;
+            if(forwards){
+                totalRefs++;
+            }else{
+                totalRefs--;
+            }
+        }
+    }
+
+    // The same as "edges" calls to step(forwards), without the loop
+    // For host tools that skip through long runs at one speed
+    auto advance(uint32_t edges, int forwards) -> void {
+        if(edges==0){
+            return;
+        }
+        const auto quarter = static_cast<int>(edges % 4);
+        nextStateIndex = (nextStateIndex + (forwards ? quarter : 4 - quarter)) % 4;
+        count(static_cast<int32_t>(forwards ? edges : 0u - edges));
+        sensorState[0]  = nextStateTable[nextStateIndex][0];
+        sensorState[1]  = nextStateTable[nextStateIndex][1];
+
+        // Work in the direction of travel: the tick count climbs from
+        // "ticks" and every time it gets to the threshold it's a
+        // revolution and starts again from 0
+        if(!countRevolutions){
+            return;
+        }
+        const int64_t ticks = forwards ? revTickCount : -revTickCount;
+        const int64_t threshold = revTickThreshold;
+        int64_t after = ticks + edges;
+        if(after >= threshold){
+            const int64_t past = after - threshold;
+            const auto revolutions = static_cast<int>(1 + past / threshold);
+            totalRefs += forwards ? revolutions : -revolutions;
+            after = past % threshold;
+        }
+        revTickCount = static_cast<int>(forwards ? after : -after);
+    }
+
+    // Makes "position" the current position without moving the pins
+    auto preset(int position) -> void {
+        transitionCount = position;
+        if(countRevolutions){
+            totalRefs = position / revTickThreshold;
+            revTickCount = position % revTickThreshold;
+        }
+    }
+};
@@ -0,0 +1,120 @@
+// Multi channel encoder outputs through MCP23017 I2C port expanders
+//
+// The Free-Wili only has a few free GPIOs, an MCP23017 adds 16 more
+// (8 encoder channels) per I2C address, up to 8 of them on one bus. Takes
+// the pin mask from the multi channel engine (multichannel.h, channel n's
+// A is bit 2n and B bit 2n+1) so expander e gets channels 8e to 8e+7:
+// port A = channels' A and B for the first 4, port B for the next 4.
+//
+// Every tick's changes are coalesced into at most one i2cWrite per
+// expander (OLATA and OLATB in one sequential write), and expanders with
+// no change are not written at all.
+//
+// An I2C write takes a long time compared to a GPIO write, so the bus, not
+// the engine, limits how fast channels can move. The fan out keeps a
+// budget of transactions that refills at the bus's ceiling, and the engine
+// may only tick when there is budget for every expander (any of them could
+// change). A tick that has to wait is never merged with the next one, as
+// that could make a channel skip a quadrature state.
+
+#pragma once
+
+#include "fwwasm.h"
+#include "multichannel.h"
+#include <cstdint>
+
+// MCP23017 registers with IOCON.BANK = 0 (the power on default)
+const int MCP23017_IODIRA = 0x00;
+const int MCP23017_OLATA = 0x14;
+const int MCP23017_BASE_ADDRESS = 0x20;
+
+// Transactions per second on a 400 kHz bus: start, address, register,
+// two data bytes and stop is about 40 bit times
+const uint32_t I2C_FAST_MODE_WRITES_PER_SECOND = 400000 / 40;
+
+struct ExpanderFanOut {
+    static constexpr auto CHANNELS_PER_EXPANDER = 8;
+    // The bus takes 8, the engine's pin mask has room for 4
+    static constexpr auto MAX_EXPANDERS = MULTICHANNEL_MAX / CHANNELS_PER_EXPANDER;
+
+    int expanders = 0;
+    uint32_t writesPerSecond = I2C_FAST_MODE_WRITES_PER_SECOND;
+
+    // Budget in 1/1000 of a write, so it can refill every ms
+    uint32_t budget = 0;
+    uint32_t budgetMs = 0;
+
+    uint64_t written = 0; // pins as last written
+    uint32_t transactions = 0;
+    uint32_t failures = 0;
+    uint32_t waits = 0; // ticks held back for the bus
+
+    // Makes every expander pin needed for "channels" an output, all low
+    // Returns false if there are too many channels or an expander didn't answer
+    auto begin(int channels, uint32_t nowMs) -> bool {
+        expanders = (channels + CHANNELS_PER_EXPANDER - 1) / CHANNELS_PER_EXPANDER;
+        if (channels < 1 || expanders > MAX_EXPANDERS) {
+            expanders = 0;
+            return false;
+        }
+        written = 0;
+        // Starts empty, a full one would let the first ms go over the
+        // ceiling. The first tick waits for its bus time, under a ms.
+        budgetMs = nowMs;
+        budget = 0;
+        bool ok = true;
+        for (int expander = 0; expander < expanders; expander++) {
+            unsigned char levels[2] = {0, 0};
+            unsigned char directions[2] = {0, 0};
+            ok = i2cWrite(MCP23017_BASE_ADDRESS + expander, MCP23017_OLATA, levels, 2) != 0 && ok;
+            ok = i2cWrite(MCP23017_BASE_ADDRESS + expander, MCP23017_IODIRA, directions, 2) != 0 && ok;
+        }
+        return ok;
+    }
+
+    // True if the bus can take a tick now, false means don't tick yet
+    auto canTick(uint32_t nowMs) -> bool {
+        const uint32_t elapsed = nowMs - budgetMs;
+        budgetMs = nowMs;
+        const uint64_t refilled = budget + static_cast<uint64_t>(elapsed) * writesPerSecond;
+        budget = refilled > capacity() ? capacity() : static_cast<uint32_t>(refilled);
+        if (budget < static_cast<uint32_t>(expanders) * 1000) {
+            waits++;
+            return false;
+        }
+        return true;
+    }
+
+    // Writes the expanders whose pins changed, one transaction each
+    auto write(uint64_t pins) -> void {
+        const uint64_t changed = pins ^ written;
+        for (int expander = 0; expander < expanders; expander++) {
+            const int shift = expander * 2 * CHANNELS_PER_EXPANDER;
+            if (((changed >> shift) & 0xFFFFu) == 0) {
+                continue;
+            }
+            unsigned char levels[2] = {static_cast<unsigned char>(pins >> shift),
+                                       static_cast<unsigned char>(pins >> (shift + 8))};
+            budget -= budget >= 1000 ? 1000 : budget;
+            transactions++;
+            if (i2cWrite(MCP23017_BASE_ADDRESS + expander, MCP23017_OLATA, levels, 2) == 0) {
+                failures++;
+                continue;
+            }
+            const uint64_t mask = 0xFFFFull << shift;
+            written = (written & ~mask) | (pins & mask);
+        }
+    }
+
+    // Fastest the engine can tick with every channel moving on every tick
+    auto maxTicksPerSecond() const -> uint32_t {
+        return expanders == 0 ? 0 : writesPerSecond / static_cast<uint32_t>(expanders);
+    }
+
+private:
+    // A tick's worth of writes plus one ms of refill, so a quiet spell
+    // can't save up a burst the bus couldn't take
+    auto capacity() const -> uint32_t {
+        return static_cast<uint32_t>(expanders) * 1000 + writesPerSecond;
+    }
+};
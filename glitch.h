@@ -0,0 +1,62 @@
+// Finds the device under test's input filter thresholds
+//
+// Two searches, both run with the encoder stopped and the DUT read back
+// (see dut_readback.h) before and after every probe:
+//  - Filter threshold: a pulse on one channel with an edge on the other
+//    channel in the middle of it. Seen from our side that is three forward
+//    steps (00 -> 10 -> 11 -> 01). A DUT that filters the pulse out only
+//    sees the middle edge, which is one step backwards (00 -> 01), so
+//    its count ends up 4 short. Every transition is a legal one, so the
+//    DUT's handling of illegal jumps doesn't matter.
+//  - Pass threshold: a burst of normal forward steps at a fixed spacing,
+//    the DUT has to count all of them.
+// Both look for the shortest width the DUT still counts, by halving.
+//
+// The millisecond clock is much too coarse for filter widths, so widths
+// are in pin writes: the pulse is stretched by writing the level it
+// already has over and over, which is the fastest output path there is.
+// The time one write takes is measured before the search so the results
+// can be given in ns too.
+
+#pragma once
+
+#include <cstdint>
+
+// Widest pulse / spacing tried, in pin writes
+const uint16_t GLITCH_MAX_WRITES = 4096;
+// Steps in every pass threshold burst
+const int GLITCH_PASS_STEPS = 8;
+
+// Binary search for the smallest width in 1..maxWidth that is counted
+// Assumes anything wider than a counted width is counted too
+struct ThresholdSearch {
+    uint16_t low = 1;
+    uint16_t high = 1; // smallest width known to be counted
+
+    auto start(uint16_t maxWidth) -> void {
+        low = 1;
+        high = static_cast<uint16_t>(maxWidth + 1);
+    }
+
+    auto done() const -> bool {
+        return low >= high;
+    }
+
+    // Width to try next
+    auto probe() const -> uint16_t {
+        return static_cast<uint16_t>(low + (high - low) / 2);
+    }
+
+    auto report(bool counted) -> void {
+        if (counted) {
+            high = probe();
+        } else {
+            low = static_cast<uint16_t>(probe() + 1);
+        }
+    }
+
+    // The answer once done(), maxWidth + 1 if nothing was counted
+    auto threshold() const -> uint16_t {
+        return low;
+    }
+};
@@ -0,0 +1,391 @@
+// Maps which settings the Free-Wili can keep up with
+//
+// Runs the encoder engine (encoder_engine.h) through a model of the main
+// loop in quadrature.cpp on a virtual clock that every host call moves on
+// by what it costs on the device (device_costs.h). One instance for every
+// combination of:
+//  - 1/4 period (ms)
+//  - teeth
+//  - mode: plain, linear scale, sin/cos DAC or DUT readback on
+//  - GUI period and telemetry period (the "U" line)
+// Each instance has its own engine and clock, so they run on all cores
+// from a work stealing pool. Every rate and teeth is also run plain with
+// the GUI and telemetry off, as the baseline of what the loop makes of
+// that rate on its own. An instance is safe when it never missed a
+// deadline (same rule as the app), no edge came a whole 1/4 period after
+// it was due and it made within RATE_SHORTFALL of the baseline's edges.
+// The capacity table is the fastest rate for each mode and GUI/telemetry
+// setting that is safe along with every slower one, and the edges/s it
+// really made there. Every instance also checks its counters against the
+// edges it made, and a sample is run again on one thread to check they
+// really are independent.
+//
+//   config_explorer [--seconds N] [--threads N] [--costs FILE] [--csv FILE]
+
+#include "device_costs.h"
+#include "encoder_engine.h"
+#include "linear_scale.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum class Mode { plain, linear, dac, dut };
+constexpr std::array MODES{Mode::plain, Mode::linear, Mode::dac, Mode::dut};
+constexpr const char* MODE_NAMES[] = {"plain", "linear", "dac", "dut"};
+
+constexpr std::array<unsigned, 11> RATES_MS{1, 2, 3, 4, 5, 6, 8, 10, 15, 20, 50};
+constexpr std::array<unsigned, 4> TEETH{1, 25, 100, 1024};
+constexpr std::array<unsigned, 7> GUI_MS{1, 2, 5, 10, 20, 50, 100};
+constexpr std::array<unsigned, 6> TELEMETRY_MS{10, 20, 50, 100, 250, 1000};
+
+// GUI or telemetry period for not at all, the baseline
+const unsigned OFF = 0;
+// Most a setting may fall behind the baseline's edge rate, 0.1 is 10%
+const double RATE_SHORTFALL = 0.10;
+
+// Same as quadrature.cpp
+const unsigned MISSED_DEADLINE_MIN_MS = 2;
+const unsigned DUT_READ_PERIOD_MS = 100;
+const int DUT_READ_SLACK_MS = 2;
+const int TELEMETRY_BYTES = 40;
+
+struct Config {
+    unsigned rateMs;
+    unsigned teeth;
+    Mode mode;
+    unsigned guiMs;
+    unsigned telemetryMs;
+};
+
+struct Outcome {
+    uint64_t edges = 0;
+    uint64_t misses = 0;
+    unsigned maxLateMs = 0; // as the app sees it, in whole millis()
+    int64_t maxLateUs = 0; // from when the edge was due to its pins
+    bool countsOk = true;
+
+    auto operator==(const Outcome&) const -> bool = default;
+
+    auto edgesPerSecond(uint32_t seconds) const -> double {
+        return static_cast<double>(edges) / seconds;
+    }
+
+    // How much slower than commanded, 0.05 is 5%
+    // The loop starts the next 1/4 period when it gets to an edge, not
+    // when it was due, so part of this is how the 1/4 period lines up with
+    // the 1ms millis() steps, the baseline has that part too
+    auto rateError(const Config& config, uint32_t seconds) const -> double {
+        return 1 - edgesPerSecond(seconds) * config.rateMs / 1000;
+    }
+
+    // How much slower than the baseline, what the GUI, telemetry and the
+    // mode's own work cost
+    auto shortfall(const Outcome& baseline) const -> double {
+        return baseline.edges == 0 ? 0 : 1 - static_cast<double>(edges) / static_cast<double>(baseline.edges);
+    }
+
+    // An edge later than its 1/4 period would bunch up with the next one
+    auto safe(const Config& config, const Outcome& baseline) const -> bool {
+        return misses == 0 && countsOk && maxLateUs < static_cast<int64_t>(config.rateMs) * 1000
+               && shortfall(baseline) <= RATE_SHORTFALL;
+    }
+};
+
+// One instance, start to finish on its own clock
+auto simulate(const Config& config, const DeviceCosts& costs, uint32_t seconds) -> Outcome {
+    QuadratureEngine engine;
+    engine.setTeeth(config.teeth);
+    engine.sensorRefreshRate = config.rateMs;
+    engine.stopSimulation = false;
+    LinearScale scale;
+    if (config.mode == Mode::linear) {
+        scale.configure(20000, 1000, 0);
+        engine.countRevolutions = false;
+    }
+
+    int64_t nowNs = 0;
+    const int64_t endNs = static_cast<int64_t>(seconds) * 1000000000;
+    auto charge = [&](double us, int times = 1) { nowNs += DeviceCosts::ns(us) * times; };
+    auto millis = [&]() -> unsigned {
+        charge(costs.millisUs);
+        return static_cast<unsigned>(nowNs / 1000000);
+    };
+    unsigned guiOldMillis = 0;
+    unsigned telemetryOldMillis = 0;
+    unsigned dutNextMs = 0;
+    bool indexUp = false;
+    Outcome outcome;
+
+    while (nowNs < endNs) {
+        charge(costs.waitmsUs);
+        charge(costs.loopUs);
+        const unsigned loopMs = millis();
+        if (engine.due(loopMs)) {
+            const auto edgeMillis = engine.sensorOldMillis;
+            const unsigned edgeNow = millis();
+            if (indexUp) {
+                indexUp = false;
+                charge(costs.setIOUs);
+            }
+            engine.step(engine.direction);
+            charge(costs.setIOUs, 2);
+            const int64_t lateUs = (nowNs - static_cast<int64_t>(edgeMillis) * 1000000) / 1000;
+            outcome.maxLateUs = std::max(outcome.maxLateUs, lateUs);
+            if (config.mode == Mode::linear && scale.edge(engine.transitionCount)) {
+                engine.totalRefs = scale.marksPassed;
+                indexUp = true;
+                charge(costs.setIOUs);
+            }
+            outcome.edges++;
+            charge(costs.edgeWorkUs);
+            const unsigned lateness = edgeNow - edgeMillis;
+            outcome.maxLateMs = std::max(outcome.maxLateMs, lateness);
+            if (lateness >= engine.sensorRefreshRate && lateness >= MISSED_DEADLINE_MIN_MS) {
+                outcome.misses++;
+            }
+            engine.sensorOldMillis = edgeNow + engine.sensorRefreshRate;
+            charge(costs.setPlotDataUs);
+        }
+
+        const unsigned nowMs = millis();
+        if (config.guiMs != OFF && nowMs - guiOldMillis >= config.guiMs) {
+            guiOldMillis = nowMs;
+            charge(costs.setControlValueUs, config.mode == Mode::linear ? 3 : 2);
+            charge(costs.setPlotDataUs, 2);
+        }
+        charge(costs.uartRxCountUs);
+        if (config.mode == Mode::dut && static_cast<int>(nowMs - dutNextMs) >= 0) {
+            const auto slackMs = static_cast<int>(engine.sensorOldMillis - nowMs);
+            if (slackMs >= DUT_READ_SLACK_MS) {
+                dutNextMs = nowMs + DUT_READ_PERIOD_MS;
+                charge(costs.i2cTransferUs);
+            }
+        }
+        if (config.mode == Mode::dac) {
+            charge(costs.spiTransferUs);
+        }
+        if (config.telemetryMs != OFF && nowMs - telemetryOldMillis >= config.telemetryMs) {
+            telemetryOldMillis = nowMs;
+            charge(costs.uartWriteUs);
+            charge(costs.uartByteUs, TELEMETRY_BYTES);
+        }
+        charge(costs.hasEventUs);
+    }
+
+    // Forwards all the way: every edge counted, whole revolutions in totalRefs
+    outcome.countsOk = engine.transitionCount == static_cast<int>(outcome.edges);
+    if (config.mode != Mode::linear) {
+        outcome.countsOk = outcome.countsOk && engine.totalRefs == engine.transitionCount / (4 * static_cast<int>(config.teeth));
+    } else {
+        outcome.countsOk = outcome.countsOk && engine.totalRefs == scale.marksPassed;
+    }
+    return outcome;
+}
+
+// Every worker owns a queue and takes from its back, a worker that runs
+// dry steals from the front of the others', so a run of slow instances
+// doesn't leave the other cores idle
+class WorkStealingPool {
+public:
+    template <typename Job>
+    static auto run(size_t jobs, unsigned workers, Job job) -> void {
+        std::vector<Queue> queues(workers);
+        for (size_t i = 0; i < jobs; i++) {
+            queues[i * workers / jobs].jobs.push_back(i);
+        }
+        std::vector<std::thread> threads;
+        for (unsigned self = 0; self < workers; self++) {
+            threads.emplace_back([&queues, &job, self, workers]() {
+                size_t next = 0;
+                while (take(queues, self, workers, next)) {
+                    job(next);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    static auto take(std::vector<Queue>& queues, unsigned self, unsigned workers, size_t& next) -> bool {
+        {
+            Queue& own = queues[self];
+            const std::lock_guard guard(own.lock);
+            if (!own.jobs.empty()) {
+                next = own.jobs.back();
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        for (unsigned i = 1; i < workers; i++) {
+            Queue& victim = queues[(self + i) % workers];
+            const std::lock_guard guard(victim.lock);
+            if (!victim.jobs.empty()) {
+                next = victim.jobs.front();
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    uint32_t seconds = 10;
+    unsigned threads = 0;
+    std::string costsFile;
+    std::string csvFile;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--seconds" && hasValue) {
+            seconds = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--costs" && hasValue) {
+            costsFile = argv[++i];
+        } else if (arg == "--csv" && hasValue) {
+            csvFile = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--seconds N] [--threads N] [--costs FILE] [--csv FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (seconds < 1) {
+        std::fprintf(stderr, "seconds has to be at least 1\n");
+        return 2;
+    }
+    DeviceCosts costs;
+    if (!costsFile.empty() && !costs.load(costsFile.c_str())) {
+        std::fprintf(stderr, "can't use the costs in %s\n", costsFile.c_str());
+        return 2;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<Config> configs;
+    for (const Mode mode : MODES) {
+        for (const unsigned guiMs : GUI_MS) {
+            for (const unsigned telemetryMs : TELEMETRY_MS) {
+                for (const unsigned teeth : TEETH) {
+                    for (const unsigned rateMs : RATES_MS) {
+                        configs.push_back({rateMs, teeth, mode, guiMs, telemetryMs});
+                    }
+                }
+            }
+        }
+    }
+    // The baselines go last, one for every teeth and rate in the same order
+    const size_t settings = configs.size();
+    for (const unsigned teeth : TEETH) {
+        for (const unsigned rateMs : RATES_MS) {
+            configs.push_back({rateMs, teeth, Mode::plain, OFF, OFF});
+        }
+    }
+    std::vector<Outcome> outcomes(configs.size());
+    const auto started = std::chrono::steady_clock::now();
+    WorkStealingPool::run(configs.size(), threads,
+                          [&](size_t i) { outcomes[i] = simulate(configs[i], costs, seconds); });
+    // What a setting is held against: the same rate and teeth, bare
+    auto baseline = [&](size_t i) -> const Outcome& {
+        return outcomes[settings + i % (TEETH.size() * RATES_MS.size())];
+    };
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::printf("%zu instances of %u s on %u threads in %.2f s\n", configs.size(), seconds, threads, elapsed);
+
+    bool ok = true;
+    for (size_t i = 0; i < configs.size(); i++) {
+        if (!outcomes[i].countsOk) {
+            std::printf("counters wrong: %ums %u teeth %s\n", configs[i].rateMs, configs[i].teeth,
+                        MODE_NAMES[static_cast<int>(configs[i].mode)]);
+            ok = false;
+        }
+        // Same answer on its own means nothing leaked between instances
+        if (i % 97 == 0 && !(simulate(configs[i], costs, seconds) == outcomes[i])) {
+            std::printf("instance %zu changed when run alone\n", i);
+            ok = false;
+        }
+    }
+
+    if (!csvFile.empty()) {
+        FILE* out = std::fopen(csvFile.c_str(), "w");
+        if (out == nullptr) {
+            std::fprintf(stderr, "can't write %s\n", csvFile.c_str());
+            return 2;
+        }
+        std::fprintf(out, "rate_ms,teeth,mode,gui_ms,telemetry_ms,edges_per_s,baseline_edges_per_s,rate_error,"
+                          "shortfall,misses,max_late_ms,max_late_us,safe\n");
+        for (size_t i = 0; i < settings; i++) {
+            const Config& c = configs[i];
+            const Outcome& o = outcomes[i];
+            std::fprintf(out, "%u,%u,%s,%u,%u,%.1f,%.1f,%.4f,%.4f,%llu,%u,%lld,%d\n", c.rateMs, c.teeth,
+                         MODE_NAMES[static_cast<int>(c.mode)], c.guiMs, c.telemetryMs, o.edgesPerSecond(seconds),
+                         baseline(i).edgesPerSecond(seconds), o.rateError(c, seconds), o.shortfall(baseline(i)),
+                         static_cast<unsigned long long>(o.misses), o.maxLateMs, static_cast<long long>(o.maxLateUs),
+                         o.safe(c, baseline(i)));
+        }
+        std::fclose(out);
+    }
+
+    // Fastest 1/4 period for every mode, GUI and telemetry period that is
+    // safe with all the teeth, and everything slower is too, with the
+    // fewest edges/s any of the teeth really made there
+    std::printf("\nfastest safe 1/4 period in ms (edges/s made), - if none\n");
+    std::printf("mode    gui ms");
+    for (const unsigned telemetryMs : TELEMETRY_MS) {
+        std::printf("  tel %4ums", telemetryMs);
+    }
+    std::printf("\n");
+    size_t at = 0;
+    for (const Mode mode : MODES) {
+        for (const unsigned guiMs : GUI_MS) {
+            std::printf("%-6s  %6u", MODE_NAMES[static_cast<int>(mode)], guiMs);
+            for (size_t t = 0; t < TELEMETRY_MS.size(); t++) {
+                unsigned fastest = 0;
+                double made = 0;
+                for (size_t rate = RATES_MS.size(); rate-- > 0;) {
+                    bool safe = true;
+                    double slowest = 0;
+                    for (size_t teeth = 0; teeth < TEETH.size(); teeth++) {
+                        const size_t i = at + teeth * RATES_MS.size() + rate;
+                        safe = safe && outcomes[i].safe(configs[i], baseline(i));
+                        const double edges = outcomes[i].edgesPerSecond(seconds);
+                        slowest = teeth == 0 || edges < slowest ? edges : slowest;
+                    }
+                    if (!safe) {
+                        break;
+                    }
+                    fastest = RATES_MS[rate];
+                    made = slowest;
+                }
+                if (fastest == 0) {
+                    std::printf("  %11s", "-");
+                } else {
+                    std::printf("  %2u (%5.0f)", fastest, made);
+                }
+                at += TEETH.size() * RATES_MS.size();
+            }
+            std::printf("\n");
+        }
+    }
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// Device timing from the host: the stub on device costs (device_costs.h)
+//
+// Runs the self benchmark's three cases (run_benchmark in quadrature.cpp)
+// against the stub in device time and predicts the edges/s the device
+// shows on its bench panel. Given the quadbench.txt the device wrote it
+// compares the two, and can fit the costs the benchmark pins down:
+//  - "edge" from the case without pin writes
+//  - "setIO" from the difference the two pin writes make
+//  - "waitms" from what the loop case adds, the GUI calls in it are
+//    taken from the costs as they are
+// The fitted file is what the other tools take with --costs. Also shows
+// what a pass of the main loop costs with and without the GUI refresh,
+// which is the most edges/s the loop can make.
+//
+//   cost_model [--costs FILE] [--bench quadbench.txt] [--fit FILE] [--tolerance PERCENT]
+
+#include "encoder_engine.h"
+#include "fwwasm_stub.h"
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// Same as quadrature.cpp
+const unsigned int BENCHMARK_CASE_MS = 500;
+const int BENCHMARK_BATCH = 256;
+const int PinA = 13;
+const int PinB = 27;
+
+const char* const COLUMN_NAMES[] = {"no pins", "pins", "pins+loop"};
+
+using Rates = std::array<double, 3>;
+
+// benchmark_edges() on the stub, edges/s
+auto predict_edges(const DeviceCosts& costs, bool withPins, bool withLoop) -> double {
+    stub::useDeviceCosts(costs);
+    QuadratureEngine engine;
+    uint64_t edges = 0;
+    const unsigned int start = millis();
+    unsigned int elapsed = 0;
+    do {
+        for (int i = 0; i < BENCHMARK_BATCH; i++) {
+            if (withLoop) {
+                waitms(1);
+                setControlValue(0, 0, engine.transitionCount);
+                setControlValue(0, 0, engine.totalRefs);
+                setPlotData(1, 1, engine.sensorState[0]);
+                setPlotData(0, 1, engine.sensorState[1]);
+            }
+            stub::chargeEdge();
+            engine.step(engine.direction);
+            if (withPins) {
+                setIO(PinA, engine.sensorState[0]);
+                setIO(PinB, engine.sensorState[1]);
+            }
+        }
+        edges += BENCHMARK_BATCH;
+        elapsed = millis() - start;
+    } while (elapsed < BENCHMARK_CASE_MS);
+    // The device works it out in whole edges/s
+    return static_cast<double>(edges * 1000 / elapsed);
+}
+
+auto predict(const DeviceCosts& costs) -> Rates {
+    return {predict_edges(costs, false, false), predict_edges(costs, true, false), predict_edges(costs, true, true)};
+}
+
+// One pass of the main loop at one edge per pass, in us, with the GUI
+// refresh on every pass or not at all
+auto loop_pass_us(const DeviceCosts& costs, bool withGui) -> double {
+    const int passes = 1000;
+    stub::useDeviceCosts(costs);
+    QuadratureEngine engine;
+    for (int pass = 0; pass < passes; pass++) {
+        waitms(1);
+        stub::chargeLoop();
+        (void)millis();
+        stub::chargeEdge();
+        engine.step(1);
+        setIO(PinA, engine.sensorState[0]);
+        setIO(PinB, engine.sensorState[1]);
+        (void)millis();
+        if (withGui) {
+            setControlValue(0, 0, engine.transitionCount);
+            setControlValue(0, 0, engine.totalRefs);
+            setPlotData(1, 1, engine.sensorState[0]);
+            setPlotData(0, 1, engine.sensorState[1]);
+        }
+        (void)UARTDataRxCount();
+        (void)hasEvent();
+    }
+    return static_cast<double>(stub::deviceNs()) / 1000 / passes;
+}
+
+// The last run in a quadbench.txt, every case averaged: a "bench <ms>"
+// line and then "<case> <no pins> <pins> <pins+loop>" for each case
+auto read_bench(const char* path, Rates& rates) -> bool {
+    FILE* file = std::fopen(path, "r");
+    if (file == nullptr) {
+        return false;
+    }
+    Rates sum{};
+    int cases = 0;
+    char line[256];
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+        char name[64] = {};
+        double noPins = 0;
+        double pins = 0;
+        double loop = 0;
+        if (std::strncmp(line, "bench", 5) == 0) {
+            sum = {};
+            cases = 0;
+        } else if (std::sscanf(line, "%63s %lf %lf %lf", name, &noPins, &pins, &loop) == 4) {
+            sum[0] += noPins;
+            sum[1] += pins;
+            sum[2] += loop;
+            cases++;
+        }
+    }
+    std::fclose(file);
+    if (cases == 0) {
+        return false;
+    }
+    for (size_t column = 0; column < rates.size(); column++) {
+        rates[column] = sum[column] / cases;
+    }
+    return true;
+}
+
+// The costs that make the model give the measured rates, the ones the
+// benchmark can't tell apart are left as they are
+auto fit(const DeviceCosts& costs, const Rates& measured) -> DeviceCosts {
+    DeviceCosts fitted = costs;
+    const double noPinsUs = 1e6 / measured[0];
+    const double pinsUs = 1e6 / measured[1];
+    const double loopUs = 1e6 / measured[2];
+    // A millis() every batch is in there too
+    fitted.edgeWorkUs = noPinsUs - costs.millisUs / BENCHMARK_BATCH;
+    fitted.setIOUs = (pinsUs - noPinsUs) / 2;
+    fitted.waitmsUs = loopUs - pinsUs - 2 * costs.setControlValueUs - 2 * costs.setPlotDataUs;
+    return fitted;
+}
+
+auto print_rates(const char* title, const Rates& rates) -> void {
+    std::printf("%-10s", title);
+    for (const double rate : rates) {
+        std::printf(" %10.0f", rate);
+    }
+    std::printf("\n");
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    std::string costsFile;
+    std::string benchFile;
+    std::string fitFile;
+    double tolerance = 10;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--costs" && hasValue) {
+            costsFile = argv[++i];
+        } else if (arg == "--bench" && hasValue) {
+            benchFile = argv[++i];
+        } else if (arg == "--fit" && hasValue) {
+            fitFile = argv[++i];
+        } else if (arg == "--tolerance" && hasValue) {
+            tolerance = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--costs FILE] [--bench quadbench.txt] [--fit FILE] [--tolerance PERCENT]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+    DeviceCosts costs;
+    if (!costsFile.empty() && !costs.load(costsFile.c_str())) {
+        std::fprintf(stderr, "can't use the costs in %s\n", costsFile.c_str());
+        return 2;
+    }
+    if (!fitFile.empty() && benchFile.empty()) {
+        std::fprintf(stderr, "--fit needs a --bench file to fit to\n");
+        return 2;
+    }
+
+    std::printf("edges/s   ");
+    for (const char* name : COLUMN_NAMES) {
+        std::printf(" %10s", name);
+    }
+    std::printf("\n");
+    const Rates predicted = predict(costs);
+    print_rates("predicted", predicted);
+
+    bool ok = true;
+    if (!benchFile.empty()) {
+        Rates measured{};
+        if (!read_bench(benchFile.c_str(), measured)) {
+            std::fprintf(stderr, "no benchmark results in %s\n", benchFile.c_str());
+            return 2;
+        }
+        print_rates("measured", measured);
+        std::printf("%-10s", "error %");
+        for (size_t column = 0; column < measured.size(); column++) {
+            const double error = (predicted[column] - measured[column]) * 100 / measured[column];
+            ok = ok && std::fabs(error) <= tolerance;
+            std::printf(" %10.1f", error);
+        }
+        std::printf("\n");
+
+        if (!fitFile.empty()) {
+            const DeviceCosts fitted = fit(costs, measured);
+            if (fitted.edgeWorkUs <= 0 || fitted.setIOUs <= 0 || fitted.waitmsUs < 1000) {
+                std::fprintf(stderr, "the results don't fit the model (edge %.2f us, setIO %.2f us, waitms %.2f us)\n",
+                             fitted.edgeWorkUs, fitted.setIOUs, fitted.waitmsUs);
+                return 1;
+            }
+            FILE* out = std::fopen(fitFile.c_str(), "w");
+            if (out == nullptr) {
+                std::fprintf(stderr, "can't write %s\n", fitFile.c_str());
+                return 2;
+            }
+            std::fprintf(out, "# Fitted to %s by cost_model\n", benchFile.c_str());
+            fitted.print(out);
+            std::fclose(out);
+            print_rates("fitted", predict(fitted));
+            costs = fitted;
+            std::printf("wrote %s\n", fitFile.c_str());
+        }
+    }
+
+    const double withGui = loop_pass_us(costs, true);
+    const double withoutGui = loop_pass_us(costs, false);
+    std::printf("main loop pass: %.0f us with the GUI, %.0f us without (%.0f%% of the pass)\n", withGui, withoutGui,
+                (withGui - withoutGui) * 100 / withGui);
+    std::printf("most edges/s at one per pass: %.0f with the GUI, %.0f without\n", 1e6 / withGui, 1e6 / withoutGui);
+    if (!benchFile.empty()) {
+        std::printf("%s (tolerance %.0f%%)\n", ok ? "ok" : "model and device disagree", tolerance);
+    }
+    return ok ? 0 : 1;
+}
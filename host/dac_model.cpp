@@ -0,0 +1,183 @@
+// Model of the sin/cos DAC back end (see sincos_dac.h)
+//
+// Stands in for the DAC on the stub's SPI bus and checks, without hardware:
+//  - the sample table: every one of the 65536 phases against std::sin
+//  - the frames: both words present with the right control bits
+//  - the signal: amplitude and phase of what the DAC would output against
+//    where the encoder really was between its edges, in real time
+//  - the update timing: time between frames against the update period
+//
+//   dac_model [--periods N] [--edges-per-rev N] [--rate-ms N] [--update-ms N] [--seconds N]
+//
+// The motion is made the same way the app makes it: one edge every rate
+// ms, with the DAC phase interpolated towards the next edge.
+
+#include "fwwasm_stub.h"
+#include "sincos_dac.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numbers>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Sample {
+    int64_t atUs;
+    int sine; // DAC codes minus DAC_MID
+    int cosine;
+};
+
+std::vector<Sample> samples;
+int badFrames = 0;
+
+auto nowUs() -> int64_t {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// A daisy chained pair of 16 bit word DACs: the first word shifted in
+// ends up in the far DAC (cosine), both latch when chip select goes up
+auto dacFrame(const unsigned char* sent, int length, unsigned char*) -> void {
+    if (length != 4) {
+        badFrames++;
+        return;
+    }
+    const int far = sent[0] << 8 | sent[1];
+    const int near = sent[2] << 8 | sent[3];
+    if ((far & 0xF000) != (DAC_WORD_CHANNEL_B | DAC_WORD_CONFIG) || (near & 0xF000) != DAC_WORD_CONFIG) {
+        badFrames++;
+        return;
+    }
+    samples.push_back({nowUs(), (near & 0x0FFF) - DAC_MID, (far & 0x0FFF) - DAC_MID});
+}
+
+// Largest difference between the table and the real sine, in DAC codes
+auto tableError() -> double {
+    double worst = 0;
+    for (uint32_t phase = 0; phase < 65536; phase++) {
+        const double ideal =
+            DAC_MID + DAC_AMPLITUDE * std::sin(2 * std::numbers::pi * static_cast<double>(phase) / 65536);
+        worst = std::fmax(worst, std::fabs(SinCosDac::code(static_cast<uint16_t>(phase)) - ideal));
+    }
+    return worst;
+}
+
+// Wraps an angle in periods to -0.5..0.5
+auto wrap(double periods) -> double {
+    return periods - std::round(periods);
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    uint32_t periods = 25;
+    uint32_t edgesPerRev = 100;
+    uint32_t rateMs = 10;
+    uint32_t updateMs = 1;
+    int seconds = 3;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--periods" && hasValue) {
+            periods = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--edges-per-rev" && hasValue) {
+            edgesPerRev = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--rate-ms" && hasValue) {
+            rateMs = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--update-ms" && hasValue) {
+            updateMs = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--seconds" && hasValue) {
+            seconds = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s [--periods N] [--edges-per-rev N] [--rate-ms N] [--update-ms N] [--seconds N]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+    if (periods == 0 || edgesPerRev == 0 || rateMs == 0 || updateMs == 0) {
+        std::fprintf(stderr, "all the numbers have to be more than 0\n");
+        return 2;
+    }
+
+    const double worstCode = tableError();
+    std::printf("table: worst error %.2f codes over all phases\n", worstCode);
+
+    stub::setSpiDevice(dacFrame);
+    SinCosDac dac;
+    dac.configure(periods, edgesPerRev, updateMs);
+
+    // The app's loop: edges when due, DAC updates when due, waitms(1)
+    const uint32_t startMs = millis();
+    uint32_t nextEdgeMs = startMs + rateMs;
+    int32_t position = 0;
+    // When every edge was made, edge n took the position to n + 1
+    std::vector<int64_t> edgeUs;
+    const int64_t startUs = nowUs();
+    while (millis() - startMs < static_cast<uint32_t>(seconds) * 1000) {
+        waitms(1);
+        const uint32_t now = millis();
+        if (static_cast<int32_t>(now - nextEdgeMs) >= 0) {
+            position++;
+            nextEdgeMs = now + rateMs;
+            edgeUs.push_back(nowUs());
+        }
+        if (dac.due(now)) {
+            const auto remaining = static_cast<int32_t>(nextEdgeMs - now);
+            const uint32_t towards =
+                remaining <= 0 ? 65535 : (rateMs - static_cast<uint32_t>(remaining)) * 65535 / rateMs;
+            dac.update(now, dac.phaseAt(position, towards, true));
+        }
+    }
+    const int64_t endUs = nowUs();
+
+    // Between edges the encoder the DAC stands for moves at a steady
+    // speed, one edge per rate ms, and waits if the next edge is late
+    const double periodsPerEdge = static_cast<double>(periods) / edgesPerRev;
+    const auto truePeriods = [&](int64_t atUs) {
+        const auto after = std::upper_bound(edgeUs.begin(), edgeUs.end(), atUs);
+        const auto edges = static_cast<double>(after - edgeUs.begin());
+        const int64_t lastUs = after == edgeUs.begin() ? startUs : *(after - 1);
+        const double fraction = std::fmin(1.0, static_cast<double>(atUs - lastUs) / (rateMs * 1000.0));
+        return (edges + fraction) * periodsPerEdge;
+    };
+    double worstAmplitude = 0;
+    double worstPhase = 0;
+    double meanPhase = 0;
+    int64_t worstGapUs = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        const Sample& sample = samples[i];
+        const double amplitude = std::hypot(sample.sine, sample.cosine);
+        worstAmplitude = std::fmax(worstAmplitude, std::fabs(amplitude - DAC_AMPLITUDE));
+        const double measured = std::atan2(sample.sine, sample.cosine) / (2 * std::numbers::pi);
+        const double error = wrap(measured - truePeriods(sample.atUs));
+        meanPhase += error;
+        worstPhase = std::fmax(worstPhase, std::fabs(error));
+        if (i > 0) {
+            worstGapUs = std::max(worstGapUs, sample.atUs - samples[i - 1].atUs);
+        }
+    }
+    const auto count = static_cast<double>(samples.size());
+    meanPhase = count > 0 ? meanPhase / count : 0;
+    const double meanGapUs = count > 1 ? static_cast<double>(samples.back().atUs - samples.front().atUs) / (count - 1) : 0;
+    // The fraction comes from the ms clock, so it can be a ms off, plus
+    // about a code worth of angle from the quantization
+    const double allowedPhase =
+        periodsPerEdge * std::fmin(1.0, 1.5 / rateMs) + 1.0 / (2 * std::numbers::pi * DAC_AMPLITUDE);
+
+    std::printf("frames: %zu good, %d bad, expected about %.0f\n", samples.size(), badFrames,
+                static_cast<double>(endUs - startUs) / (updateMs * 1000.0));
+    std::printf("timing: mean %.0f us between updates (set %u us), worst %lld us\n", meanGapUs, updateMs * 1000,
+                static_cast<long long>(worstGapUs));
+    std::printf("signal: worst amplitude error %.2f codes, phase error mean %.2f worst %.2f degrees (allowed %.2f)\n",
+                worstAmplitude, meanPhase * 360, worstPhase * 360, allowedPhase * 360);
+
+    const bool ok = worstCode <= 1.0 && badFrames == 0 && samples.size() > 1 && worstAmplitude <= 2.0
+                    && worstPhase <= allowedPhase && meanGapUs < updateMs * 1000.0 * 1.5;
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
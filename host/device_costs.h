@@ -0,0 +1,96 @@
+// What things cost on the Free-Wili, for the host tools that model its
+// timing instead of going by how fast the PC runs the same code
+//
+// Every host call (fwwasm.h import) and the loop's own work has a cost in
+// microseconds. The defaults are rough figures; a calibration file from
+// the device replaces them, one "<name> <us>" per line, "#" comments:
+//   setIO 12.5
+//   setControlValue 140
+// cost_model --fit writes one from the quadbench.txt of the self benchmark.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+struct DeviceCosts {
+    // waitms(1) sleeps for the 1ms plus the scheduler's overhead
+    double waitmsUs = 1030;
+    double millisUs = 4;
+    double setIOUs = 12;
+    double setControlValueUs = 140;
+    double setPlotDataUs = 180;
+    double hasEventUs = 6;
+    double uartRxCountUs = 8;
+    double uartWriteUs = 30; // per call
+    double uartByteUs = 1.5; // and per byte
+    double spiTransferUs = 45; // one SPIReadWrite of a few bytes
+    double i2cTransferUs = 180; // one i2cRead of a few bytes
+    // The loop's own code between host calls, and the extra per edge
+    // (recorder, trend, schedule checks)
+    double loopUs = 15;
+    double edgeWorkUs = 25;
+
+    struct Entry {
+        const char* name;
+        double DeviceCosts::*value;
+    };
+    static constexpr Entry ENTRIES[] = {
+        {"waitms", &DeviceCosts::waitmsUs},
+        {"millis", &DeviceCosts::millisUs},
+        {"setIO", &DeviceCosts::setIOUs},
+        {"setControlValue", &DeviceCosts::setControlValueUs},
+        {"setPlotData", &DeviceCosts::setPlotDataUs},
+        {"hasEvent", &DeviceCosts::hasEventUs},
+        {"UARTDataRxCount", &DeviceCosts::uartRxCountUs},
+        {"UARTDataWrite", &DeviceCosts::uartWriteUs},
+        {"uartByte", &DeviceCosts::uartByteUs},
+        {"SPIReadWrite", &DeviceCosts::spiTransferUs},
+        {"i2cRead", &DeviceCosts::i2cTransferUs},
+        {"loop", &DeviceCosts::loopUs},
+        {"edge", &DeviceCosts::edgeWorkUs},
+    };
+
+    // Cost of one call in ns
+    static auto ns(double us) -> int64_t {
+        return static_cast<int64_t>(us * 1000 + 0.5);
+    }
+
+    // Reads a calibration file over the defaults, false if it can't be
+    // read or has a name that isn't known
+    auto load(const char* path) -> bool {
+        FILE* file = std::fopen(path, "r");
+        if (file == nullptr) {
+            return false;
+        }
+        char line[256];
+        bool ok = true;
+        while (std::fgets(line, sizeof(line), file) != nullptr) {
+            char name[64] = {};
+            double us = 0;
+            if (line[0] == '#' || std::sscanf(line, "%63s %lf", name, &us) != 2) {
+                continue;
+            }
+            bool known = false;
+            for (const Entry& entry : ENTRIES) {
+                if (std::strcmp(entry.name, name) == 0) {
+                    this->*entry.value = us;
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::fprintf(stderr, "%s: unknown cost \"%s\"\n", path, name);
+                ok = false;
+            }
+        }
+        std::fclose(file);
+        return ok;
+    }
+
+    auto print(FILE* out) const -> void {
+        for (const Entry& entry : ENTRIES) {
+            std::fprintf(out, "%s %.2f\n", entry.name, this->*entry.value);
+        }
+    }
+};
@@ -0,0 +1,176 @@
+// Model of the I2C port expander fan out (see expander_fanout.h)
+//
+// Puts MCP23017 models on the stub's I2C bus and runs the multi channel
+// engine through the fan out on a simulated clock, as fast as the bus
+// budget lets it tick. For every channel count it checks that:
+//  - the expander outputs always match the engine's pins after a tick
+//  - no channel ever changes A and B in the same write
+//  - the bus is never asked for more time than it has had, at any ms
+//  - the writes/s over the whole run stay within the ceiling
+// and prints the tick rate and bus load it got.
+//
+//   expander_model [--seconds N] [--writes-per-second N]
+
+#include "expander_fanout.h"
+#include "fwwasm_stub.h"
+#include "multichannel.h"
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace {
+
+// Just the registers the fan out uses, sequential addressing (IOCON = 0)
+struct Mcp23017 {
+    std::array<unsigned char, 0x16> registers{};
+
+    Mcp23017() {
+        // IODIR powers up as all inputs
+        registers[MCP23017_IODIRA] = 0xFF;
+        registers[MCP23017_IODIRA + 1] = 0xFF;
+    }
+
+    // What the pins show, inputs read as 0
+    auto outputs() const -> uint16_t {
+        const auto latch = static_cast<uint16_t>(registers[MCP23017_OLATA] | registers[MCP23017_OLATA + 1] << 8);
+        const auto inputs =
+            static_cast<uint16_t>(registers[MCP23017_IODIRA] | registers[MCP23017_IODIRA + 1] << 8);
+        return static_cast<uint16_t>(latch & ~inputs);
+    }
+};
+
+std::array<Mcp23017, ExpanderFanOut::MAX_EXPANDERS> expanders;
+uint64_t busBits = 0;
+int illegalSteps = 0;
+
+// Pin mask as the expanders show it
+auto expanderPins() -> uint64_t {
+    uint64_t pins = 0;
+    for (size_t i = 0; i < expanders.size(); i++) {
+        pins |= static_cast<uint64_t>(expanders[i].outputs()) << (16 * i);
+    }
+    return pins;
+}
+
+auto onBus(bool write, int address, int reg, unsigned char* data, int length) -> bool {
+    const int index = address - MCP23017_BASE_ADDRESS;
+    if (index < 0 || index >= static_cast<int>(expanders.size())) {
+        return false;
+    }
+    // start, address + ack, register + ack, data + acks, stop
+    busBits += 1 + 9 + 9 + 9 * static_cast<uint64_t>(length) + 1;
+    Mcp23017& expander = expanders[static_cast<size_t>(index)];
+    const uint16_t before = expander.outputs();
+    for (int i = 0; i < length; i++) {
+        const auto at = static_cast<size_t>(reg + i) % expander.registers.size();
+        if (write) {
+            expander.registers[at] = data[i];
+        } else {
+            data[i] = expander.registers[at];
+        }
+    }
+    // Pins pair up as A, B of a channel: both changing at once is a
+    // quadrature state skipped
+    const uint16_t changed = before ^ expander.outputs();
+    if ((changed & (changed >> 1) & 0x5555u) != 0) {
+        illegalSteps++;
+    }
+    return true;
+}
+
+struct Result {
+    uint64_t ticks = 0;
+    uint64_t writes = 0;
+    uint64_t mismatches = 0;
+    bool overloaded = false;
+};
+
+auto run(int channels, uint32_t writesPerSecond, uint32_t seconds, bool everyTick) -> Result {
+    expanders = {};
+    busBits = 0;
+    MultiChannelEngine engine;
+    std::mt19937 random(static_cast<unsigned>(channels));
+    for (int channel = 0; channel < channels; channel++) {
+        engine.configure(channel, everyTick ? 1 : 1 + random() % 8, random() % 2 == 0, true);
+    }
+    ExpanderFanOut fanOut;
+    fanOut.writesPerSecond = writesPerSecond;
+    fanOut.begin(channels, 0);
+    busBits = 0;
+
+    Result result;
+    for (uint32_t ms = 0; ms < seconds * 1000; ms++) {
+        while (fanOut.canTick(ms)) {
+            const uint64_t pins = engine.tick();
+            fanOut.write(pins);
+            result.ticks++;
+            if (expanderPins() != pins) {
+                result.mismatches++;
+            }
+        }
+        // The bus time asked for so far must fit in the time gone by
+        const uint64_t bitsPerWrite = 40;
+        const uint64_t allowedBits = (static_cast<uint64_t>(ms) + 1) * writesPerSecond * bitsPerWrite / 1000;
+        if (busBits > allowedBits) {
+            result.overloaded = true;
+        }
+    }
+    result.writes = fanOut.transactions;
+    if (result.writes > static_cast<uint64_t>(writesPerSecond) * seconds) {
+        result.overloaded = true;
+    }
+    return result;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    uint32_t seconds = 2;
+    uint32_t writesPerSecond = I2C_FAST_MODE_WRITES_PER_SECOND;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--seconds" && hasValue) {
+            seconds = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--writes-per-second" && hasValue) {
+            writesPerSecond = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--seconds N] [--writes-per-second N]\n", argv[0]);
+            return 2;
+        }
+    }
+    stub::setI2cDevice(onBus);
+
+    std::printf("bus ceiling %u writes/s\n", writesPerSecond);
+    // "all move": every channel steps on every tick, the worst case, so
+    //   ticks/s is also the edge rate every channel gets
+    // "mixed": channels step every 1 to 8 ticks, expanders with nothing
+    //   to change are skipped and the saved writes go into more ticks
+    std::printf("                             all move            mixed\n");
+    std::printf("channels  expanders  max ticks/s  ticks/s  writes/s  ticks/s  writes/s\n");
+    bool ok = true;
+    for (int channels : {1, 2, 4, 8, 12, 16, 24, 32}) {
+        ExpanderFanOut sizing;
+        sizing.writesPerSecond = writesPerSecond;
+        sizing.begin(channels, 0);
+        illegalSteps = 0;
+        const Result all = run(channels, writesPerSecond, seconds, true);
+        const Result mixed = run(channels, writesPerSecond, seconds, false);
+        std::printf("%8d  %9d  %11u  %7llu  %8llu  %7llu  %8llu\n", channels, sizing.expanders,
+                    sizing.maxTicksPerSecond(), static_cast<unsigned long long>(all.ticks / seconds),
+                    static_cast<unsigned long long>(all.writes / seconds),
+                    static_cast<unsigned long long>(mixed.ticks / seconds),
+                    static_cast<unsigned long long>(mixed.writes / seconds));
+        if (all.mismatches != 0 || mixed.mismatches != 0 || all.overloaded || mixed.overloaded || illegalSteps != 0) {
+            std::printf("  FAILED: %llu/%llu pin mismatches, overloaded %d/%d, %d skipped states\n",
+                        static_cast<unsigned long long>(all.mismatches),
+                        static_cast<unsigned long long>(mixed.mismatches), all.overloaded, mixed.overloaded,
+                        illegalSteps);
+            ok = false;
+        }
+    }
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+// Host side stand-in for the Free-Wili firmware, see fwwasm_stub.h
+
+#include "fwwasm_stub.h"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <sys/ioctl.h>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+
+namespace {
+
+const auto startTime = std::chrono::steady_clock::now();
+int64_t clockOffsetMs = 0;
+int64_t clockDriftPpm = 0;
+
+// Set by useDeviceCosts, per thread so tools can run one model a thread
+thread_local std::optional<DeviceCosts> deviceCosts;
+thread_local int64_t deviceTimeNs = 0;
+
+// Moves device time on by one call of what "cost" is the cost of
+auto charge(double DeviceCosts::*cost) -> void {
+    if (deviceCosts) {
+        deviceTimeNs += DeviceCosts::ns((*deviceCosts).*cost);
+    }
+}
+
+int uartFd = -1;
+
+// The Free-Wili has fewer GPIOs than this, it's just a safe bound
+std::array<int, 64> pins{};
+
+stub::PinWatcher pinWatcher;
+stub::SpiDevice spiDevice;
+stub::I2cDevice i2cDevice;
+
+} // namespace
+
+namespace stub {
+
+auto setClockSkew(int64_t offsetMs, int64_t driftPpm) -> void {
+    clockOffsetMs = offsetMs;
+    clockDriftPpm = driftPpm;
+}
+
+auto useDeviceCosts(const DeviceCosts& costs) -> void {
+    deviceCosts = costs;
+    deviceTimeNs = 0;
+}
+
+auto chargeLoop() -> void {
+    charge(&DeviceCosts::loopUs);
+}
+
+auto chargeEdge() -> void {
+    charge(&DeviceCosts::edgeWorkUs);
+}
+
+auto deviceNs() -> int64_t {
+    return deviceTimeNs;
+}
+
+auto setUartFd(int fd) -> void {
+    uartFd = fd;
+}
+
+auto pinLevel(int io) -> int {
+    return pins.at(static_cast<size_t>(io));
+}
+
+auto setPinWatcher(PinWatcher watcher) -> void {
+    pinWatcher = std::move(watcher);
+}
+
+auto setSpiDevice(SpiDevice device) -> void {
+    spiDevice = std::move(device);
+}
+
+auto setI2cDevice(I2cDevice device) -> void {
+    i2cDevice = std::move(device);
+}
+
+} // namespace stub
+
+extern "C" {
+
+void waitms(int milliseconds) {
+    if (deviceCosts) {
+        // The cost is for waitms(1), the rest is just the longer wait
+        deviceTimeNs += int64_t{milliseconds - 1} * 1000000 + DeviceCosts::ns(deviceCosts->waitmsUs);
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+unsigned int millis(void) {
+    if (deviceCosts) {
+        charge(&DeviceCosts::millisUs);
+        return static_cast<unsigned int>(deviceTimeNs / 1000000 + clockOffsetMs);
+    }
+    const auto elapsedUs =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+    const int64_t skewedUs = elapsedUs + elapsedUs * clockDriftPpm / 1000000;
+    return static_cast<unsigned int>(skewedUs / 1000 + clockOffsetMs);
+}
+
+void setIO(int io, int on) {
+    charge(&DeviceCosts::setIOUs);
+    int& pin = pins.at(static_cast<size_t>(io));
+    const int level = on ? 1 : 0;
+    if (pinWatcher && pin != level) {
+        const int64_t atNs = deviceCosts ? deviceTimeNs
+                                         : std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                               std::chrono::steady_clock::now() - startTime)
+                                               .count();
+        pinWatcher(io, level, atNs);
+    }
+    pin = level;
+}
+
+unsigned int getIO(int io) {
+    return static_cast<unsigned int>(pins.at(static_cast<size_t>(io)));
+}
+
+unsigned int getAllIO(void) {
+    unsigned int all = 0;
+    for (size_t io = 0; io < 32; io++) {
+        all |= static_cast<unsigned int>(pins[io]) << io;
+    }
+    return all;
+}
+
+int UARTDataRxCount(void) {
+    charge(&DeviceCosts::uartRxCountUs);
+    int count = 0;
+    if (uartFd < 0 || ioctl(uartFd, FIONREAD, &count) != 0) {
+        return 0;
+    }
+    return count;
+}
+
+int UARTDataRead(unsigned char* data, int length) {
+    if (uartFd < 0) {
+        return 0;
+    }
+    const auto count = read(uartFd, data, static_cast<size_t>(length));
+    return count < 0 ? 0 : static_cast<int>(count);
+}
+
+int UARTDataWrite(unsigned char* data, int length) {
+    charge(&DeviceCosts::uartWriteUs);
+    if (deviceCosts) {
+        deviceTimeNs += DeviceCosts::ns(deviceCosts->uartByteUs) * length;
+    }
+    if (uartFd < 0) {
+        return length;
+    }
+    const auto count = write(uartFd, data, static_cast<size_t>(length));
+    return count < 0 ? 0 : static_cast<int>(count);
+}
+
+int SPIReadWrite(unsigned char* data_in, int length, unsigned char* data_out) {
+    charge(&DeviceCosts::spiTransferUs);
+    std::memset(data_out, 0, static_cast<size_t>(length));
+    if (spiDevice) {
+        spiDevice(data_in, length, data_out);
+    }
+    return 1;
+}
+
+int i2cRead(int address, int reg, unsigned char* data, int length) {
+    charge(&DeviceCosts::i2cTransferUs);
+    return i2cDevice && i2cDevice(false, address, reg, data, length) ? 1 : 0;
+}
+
+int i2cWrite(int address, int reg, unsigned char* data, int length) {
+    charge(&DeviceCosts::i2cTransferUs);
+    return i2cDevice && i2cDevice(true, address, reg, data, length) ? 1 : 0;
+}
+
+// The GUI has nothing to show on, these are only here for what they cost
+void setControlValue(int, int, int) {
+    charge(&DeviceCosts::setControlValueUs);
+}
+
+void setPlotData(int, int, int) {
+    charge(&DeviceCosts::setPlotDataUs);
+}
+
+int hasEvent(void) {
+    charge(&DeviceCosts::hasEventUs);
+    return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,54 @@
+// Host side stand-in for the Free-Wili firmware
+// Implements the fwwasm.h imports natively so the encoder code can run
+// on a PC. These are the knobs the host tools use to set it up.
+
+#pragma once
+
+#include "device_costs.h"
+#include "fwwasm.h"
+#include <cstdint>
+#include <functional>
+
+namespace stub {
+
+// millis() follows the host monotonic clock, skewed by a fixed offset
+// and a drift in parts per million to look like a real crystal
+auto setClockSkew(int64_t offsetMs, int64_t driftPpm) -> void;
+
+// From here on this thread runs on device time: millis() is a virtual
+// clock that only moves by what each import costs on the Free-Wili, and
+// waitms() moves it on instead of sleeping. The host's own speed then
+// doesn't matter, the timing is what the device would do.
+auto useDeviceCosts(const DeviceCosts& costs) -> void;
+
+// The app's own code costs time too: a pass of the main loop, and the
+// work for an edge on top of its pin writes ("loop" and "edge")
+auto chargeLoop() -> void;
+auto chargeEdge() -> void;
+
+// Device time used on this thread since useDeviceCosts, in ns
+auto deviceNs() -> int64_t;
+
+// UART reads and writes go to this file descriptor (a pty or serial port)
+// Until one is set the UART has nothing to read and drops all writes
+auto setUartFd(int fd) -> void;
+
+// Last level written to a pin with setIO
+auto pinLevel(int io) -> int;
+
+// Gets every setIO that changes a pin, with the time in ns: device time
+// after useDeviceCosts, host time since the start before that
+using PinWatcher = std::function<void(int io, int level, int64_t atNs)>;
+auto setPinWatcher(PinWatcher watcher) -> void;
+
+// Something on the SPI bus: gets every SPIReadWrite with the bytes sent,
+// and fills in the bytes read back (zeros if it doesn't)
+using SpiDevice = std::function<void(const unsigned char* sent, int length, unsigned char* received)>;
+auto setSpiDevice(SpiDevice device) -> void;
+
+// Everything on the I2C bus: gets every i2cRead and i2cWrite, returns
+// false if no device answered at that address
+using I2cDevice = std::function<bool(bool write, int address, int reg, unsigned char* data, int length)>;
+auto setI2cDevice(I2cDevice device) -> void;
+
+} // namespace stub
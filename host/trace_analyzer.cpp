@@ -0,0 +1,949 @@
+// Offline analyzer for encoder captures
+//
+// Reads a capture of the A and B pins and reports how good the waveform
+// was: the time between edges, the spectrum of its jitter, how far B sits
+// from 90 degrees after A, transitions that skipped a state, and how far
+// the count drifted from the commanded profile. It reads:
+//  - the simulator's trace dump (see recorder.h), "E <ms> <position>"
+//    lines, "R" lines start a new dump
+//  - a logic analyzer CSV export: the time, then a column per channel
+//    (--a-col and --b-col pick A and B, 1 and 2 if not given)
+//  - a VCD: A and B are 1 bit signals picked by name with --a and --b,
+//    the first two 1 bit signals if not given
+//
+// The file is memory mapped and cut into chunks at line boundaries. The
+// threads take chunks as they finish the last one and the results are
+// merged in order, so a capture of many gigabytes never has to fit in
+// RAM and goes as fast as the disk and the cores allow. The only things
+// lost at the chunk seams are the one B phase and the jitter segment that
+// straddle them.
+//
+//   trace_analyzer FILE [--format sim|csv|vcd] [--threads N]
+//                  [--rate N | --profile FILE] [--time-scale X]
+//                  [--a NAME] [--b NAME] [--a-col N] [--b-col N]
+//                  [--spectrum FILE]
+//
+// --rate (edges/s) or --profile ("<s> <edges/s>" lines, each rate holds
+// until the next line) are the commanded motion the drift is measured
+// against. --time-scale multiplies the CSV times (1e-9 for ns).
+// --spectrum writes every jitter bin as "<Hz>,<us rms>".
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <numbers>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+enum class Format { sim, csv, vcd };
+
+// Pins as bits: A is 1, B is 2. Going forwards the states are 0, 1, 3, 2
+// (the order of nextStateTable), this is where each one is in that order.
+constexpr int STATE_ORDER[4] = {0, 1, 3, 2};
+// And the state for a position, by position & 3
+constexpr int POSITION_STATE[4] = {0, 1, 3, 2};
+
+// Edges per jitter segment, the spectrum has half as many bins
+constexpr size_t SEGMENT = 4096;
+// A jitter line has to be this many times the median bin to be listed
+constexpr double NOISE_FLOOR = 4;
+// Chunks per thread, more evens out chunks that parse slower
+constexpr size_t CHUNKS_PER_THREAD = 4;
+
+struct Options {
+    std::string file;
+    Format format = Format::sim;
+    bool formatGiven = false;
+    unsigned threads = 0;
+    double rate = 0;
+    bool haveRate = false;
+    std::string profileFile;
+    double timeScale = 1;
+    std::string aName;
+    std::string bName;
+    int aColumn = 1;
+    int bColumn = 2;
+    std::string spectrumFile;
+};
+
+// Commanded motion: rates that each hold until the next one starts
+struct Profile {
+    std::vector<double> starts; // s
+    std::vector<double> rates; // edges/s
+    std::vector<double> positions; // commanded position at each start
+
+    auto empty() const -> bool {
+        return starts.empty();
+    }
+
+    auto add(double start, double rate) -> void {
+        double position = 0;
+        if (!starts.empty()) {
+            position = positions.back() + rates.back() * (start - starts.back());
+        }
+        starts.push_back(start);
+        rates.push_back(rate);
+        positions.push_back(position);
+    }
+
+    // Position at "t", "piece" is a cursor that only moves forwards
+    auto expected(double t, size_t& piece) const -> double {
+        while (piece + 1 < starts.size() && starts[piece + 1] <= t) {
+            piece++;
+        }
+        if (t < starts[piece]) {
+            return 0;
+        }
+        return positions[piece] + rates[piece] * (t - starts[piece]);
+    }
+};
+
+// Running mean, deviation and range that can be merged
+struct Stats {
+    uint64_t count = 0;
+    double mean = 0;
+    double m2 = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    auto add(double x) -> void {
+        count++;
+        const double delta = x - mean;
+        mean += delta / static_cast<double>(count);
+        m2 += delta * (x - mean);
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+
+    auto merge(const Stats& other) -> void {
+        if (other.count == 0) {
+            return;
+        }
+        const double total = static_cast<double>(count + other.count);
+        const double delta = other.mean - mean;
+        m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / total;
+        mean += delta * static_cast<double>(other.count) / total;
+        count += other.count;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+
+    auto deviation() const -> double {
+        return count > 1 ? std::sqrt(m2 / static_cast<double>(count - 1)) : 0;
+    }
+};
+
+// What one chunk found. Positions and drift count from 0 at its start,
+// the merge adds the edges of the chunks before.
+struct ChunkResult {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    int endState = -1;
+    bool unresolved = false; // a VCD pin that never changed, run again
+    bool brokenBeforeFirstEdge = false; // the trace restarted first
+    bool haveEdge = false;
+    double firstEdge = 0;
+    double lastEdge = 0;
+    uint64_t edges = 0;
+    uint64_t illegal = 0;
+    int64_t net = 0;
+    double driftMin = std::numeric_limits<double>::infinity();
+    double driftMax = -std::numeric_limits<double>::infinity();
+    Stats interval; // s
+    Stats phase; // degrees from 90
+    std::vector<double> power; // summed |X|^2 per bin
+    uint64_t segments = 0;
+};
+
+auto fft(std::vector<std::complex<double>>& data) -> void {
+    const size_t n = data.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; (j & bit) != 0; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+    for (size_t length = 2; length <= n; length <<= 1) {
+        const double angle = -2 * std::numbers::pi / static_cast<double>(length);
+        const std::complex<double> step(std::cos(angle), std::sin(angle));
+        for (size_t i = 0; i < n; i += length) {
+            std::complex<double> w(1);
+            for (size_t k = 0; k < length / 2; k++) {
+                const std::complex<double> even = data[i + k];
+                const std::complex<double> odd = data[i + k + length / 2] * w;
+                data[i + k] = even + odd;
+                data[i + k + length / 2] = even - odd;
+                w *= step;
+            }
+        }
+    }
+}
+
+// Turns pin states into edges and keeps the statistics of one chunk
+class Analyzer {
+public:
+    Analyzer(const Profile& profile, ChunkResult& result) : profile(profile), result(result) {
+        result.power.assign(SEGMENT / 2 + 1, 0);
+        segment.reserve(SEGMENT);
+    }
+
+    // Pins just before the chunk starts
+    auto prime(int pins) -> void {
+        state = pins;
+    }
+
+    // The trace starts again (a new dump), nothing carries over
+    auto restart() -> void {
+        if (!result.haveEdge) {
+            result.brokenBeforeFirstEdge = true;
+        }
+        state = -1;
+        haveEdge = false;
+        haveA = false;
+        haveB = false;
+        segment.clear();
+    }
+
+    auto sample(double t, int pins) -> void {
+        if (state < 0) {
+            state = pins;
+            return;
+        }
+        const int changed = pins ^ state;
+        if (changed == 0) {
+            return;
+        }
+        const int steps = (STATE_ORDER[pins] - STATE_ORDER[state] + 4) % 4;
+        state = pins;
+        if (changed == 3) {
+            // Both pins at once, a state was skipped and the direction
+            // is unknown. Timing starts again from here.
+            result.illegal++;
+            haveA = false;
+            haveB = false;
+            segment.clear();
+            markEdge(t);
+            return;
+        }
+        result.edges++;
+        result.net += steps == 1 ? 1 : -1;
+        markEdge(t);
+
+        if (changed == 1) {
+            // B should be half way between two A edges
+            if (haveA && haveB) {
+                result.phase.add(((lastB - lastA) / (t - lastA) - 0.5) * 180);
+            }
+            haveA = true;
+            haveB = false;
+            lastA = t;
+        } else {
+            haveB = haveA;
+            lastB = t;
+        }
+
+        if (!profile.empty()) {
+            const double drift = static_cast<double>(result.net) - profile.expected(t, piece);
+            result.driftMin = std::min(result.driftMin, drift);
+            result.driftMax = std::max(result.driftMax, drift);
+        }
+    }
+
+    auto finish() -> void {
+        result.endState = state;
+    }
+
+private:
+    const Profile& profile;
+    ChunkResult& result;
+    int state = -1;
+    bool haveEdge = false;
+    double lastEdge = 0;
+    bool haveA = false;
+    bool haveB = false;
+    double lastA = 0;
+    double lastB = 0;
+    size_t piece = 0;
+    std::vector<double> segment;
+    std::vector<std::complex<double>> work;
+
+    auto markEdge(double t) -> void {
+        if (!result.haveEdge) {
+            result.haveEdge = true;
+            result.firstEdge = t;
+        }
+        result.lastEdge = t;
+        if (haveEdge) {
+            const double interval = t - lastEdge;
+            result.interval.add(interval);
+            segment.push_back(interval);
+            if (segment.size() == SEGMENT) {
+                addSegment();
+            }
+        }
+        haveEdge = true;
+        lastEdge = t;
+    }
+
+    // Hann windowed, mean removed, power added to the chunk's sum
+    auto addSegment() -> void {
+        double mean = 0;
+        for (const double x : segment) {
+            mean += x;
+        }
+        mean /= static_cast<double>(SEGMENT);
+        work.resize(SEGMENT);
+        for (size_t i = 0; i < SEGMENT; i++) {
+            const double window = 0.5 - 0.5 * std::cos(2 * std::numbers::pi * static_cast<double>(i) / SEGMENT);
+            work[i] = (segment[i] - mean) * window;
+        }
+        fft(work);
+        for (size_t k = 0; k < result.power.size(); k++) {
+            result.power[k] += std::norm(work[k]);
+        }
+        result.segments++;
+        segment.clear();
+    }
+};
+
+// Lines of [begin, end), the last one doesn't need a newline
+template <typename Handle>
+auto forEachLine(const char* begin, const char* end, Handle handle) -> void {
+    while (begin < end) {
+        const auto* eol = static_cast<const char*>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+        if (eol == nullptr) {
+            eol = end;
+        }
+        const char* last = eol;
+        if (last > begin && last[-1] == '\r') {
+            last--;
+        }
+        if (!handle(std::string_view(begin, static_cast<size_t>(last - begin)))) {
+            return;
+        }
+        begin = eol + 1;
+    }
+}
+
+// Start of the line before the one at "at"
+auto previousLine(const char* fileBegin, const char* at) -> const char* {
+    const char* p = at - 1; // the newline ending it
+    while (p > fileBegin && p[-1] != '\n') {
+        p--;
+    }
+    return p;
+}
+
+auto skipSpaces(std::string_view& text) -> void {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+}
+
+template <typename Number>
+auto parseNumber(std::string_view& text, Number& value) -> bool {
+    skipSpaces(text);
+    const auto [next, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc()) {
+        return false;
+    }
+    text.remove_prefix(static_cast<size_t>(next - text.data()));
+    return true;
+}
+
+// Simulator trace ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+auto parseSimEdge(std::string_view line, double& t, int& pins) -> bool {
+    if (line.empty() || line.front() != 'E') {
+        return false;
+    }
+    line.remove_prefix(1);
+    int64_t ms = 0;
+    int64_t position = 0;
+    if (!parseNumber(line, ms) || !parseNumber(line, position)) {
+        return false;
+    }
+    t = static_cast<double>(ms) / 1000;
+    pins = POSITION_STATE[position & 3];
+    return true;
+}
+
+auto analyzeSim(const char* fileBegin, Analyzer& analyzer, ChunkResult& chunk) -> void {
+    // Pins from the last edge before the chunk, unless a dump starts
+    // in between. Events can sit between edges.
+    const char* line = chunk.begin;
+    for (int back = 0; back < 64 && line > fileBegin; back++) {
+        line = previousLine(fileBegin, line);
+        double t = 0;
+        int pins = 0;
+        if (*line == 'R') {
+            break;
+        }
+        if (parseSimEdge(std::string_view(line, static_cast<size_t>(chunk.begin - line)), t, pins)) {
+            analyzer.prime(pins);
+            break;
+        }
+    }
+    forEachLine(chunk.begin, chunk.end, [&](std::string_view text) {
+        double t = 0;
+        int pins = 0;
+        if (parseSimEdge(text, t, pins)) {
+            analyzer.sample(t, pins);
+        } else if (!text.empty() && text.front() == 'R') {
+            analyzer.restart();
+        }
+        return true;
+    });
+}
+
+// CSV ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+auto parseCsvRow(std::string_view line, const Options& options, double& t, int& pins) -> bool {
+    if (!parseNumber(line, t)) {
+        return false; // the header, or junk
+    }
+    t *= options.timeScale;
+    pins = 0;
+    const int last = std::max(options.aColumn, options.bColumn);
+    for (int column = 1; column <= last; column++) {
+        const size_t comma = line.find(',');
+        if (comma == std::string_view::npos) {
+            return false;
+        }
+        line.remove_prefix(comma + 1);
+        if (column != options.aColumn && column != options.bColumn) {
+            continue;
+        }
+        double level = 0;
+        std::string_view field = line;
+        if (!parseNumber(field, level)) {
+            return false;
+        }
+        if (level > 0.5) {
+            pins |= column == options.aColumn ? 1 : 2;
+        }
+    }
+    return true;
+}
+
+auto analyzeCsv(const char* fileBegin, const Options& options, Analyzer& analyzer, ChunkResult& chunk) -> void {
+    if (chunk.begin > fileBegin) {
+        const char* line = previousLine(fileBegin, chunk.begin);
+        double t = 0;
+        int pins = 0;
+        if (parseCsvRow(std::string_view(line, static_cast<size_t>(chunk.begin - line)), options, t, pins)) {
+            analyzer.prime(pins);
+        }
+    }
+    forEachLine(chunk.begin, chunk.end, [&](std::string_view text) {
+        double t = 0;
+        int pins = 0;
+        if (parseCsvRow(text, options, t, pins)) {
+            analyzer.sample(t, pins);
+        }
+        return true;
+    });
+}
+
+// VCD ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct VcdHeader {
+    std::string aId;
+    std::string bId;
+    double secondsPerTick = 1e-9;
+    const char* body = nullptr; // first line after $enddefinitions
+};
+
+auto parseVcdHeader(const char* begin, const char* end, const Options& options, VcdHeader& header) -> bool {
+    std::vector<std::pair<std::string, std::string>> signals; // id, name
+    std::string timescale;
+    bool inTimescale = false;
+    forEachLine(begin, end, [&](std::string_view line) {
+        skipSpaces(line);
+        if (inTimescale || line.starts_with("$timescale")) {
+            inTimescale = line.find("$end") == std::string_view::npos;
+            timescale += std::string(line) + " ";
+        } else if (line.starts_with("$var")) {
+            // $var wire 1 <id> <name> $end
+            char type[32] = {};
+            int width = 0;
+            char id[64] = {};
+            char name[128] = {};
+            const std::string text(line);
+            if (std::sscanf(text.c_str(), "$var %31s %d %63s %127s", type, &width, id, name) == 4 && width == 1) {
+                signals.emplace_back(id, name);
+            }
+        } else if (line.starts_with("$enddefinitions")) {
+            header.body = line.data() + line.size();
+            return false;
+        }
+        return true;
+    });
+    if (header.body == nullptr) {
+        return false;
+    }
+    header.body = static_cast<const char*>(std::memchr(header.body, '\n', static_cast<size_t>(end - header.body)));
+    header.body = header.body == nullptr ? end : header.body + 1;
+
+    // "1 ns", "1ns" or "10 us"
+    const size_t digits = timescale.find_first_of("0123456789", timescale.find("$timescale") + 10);
+    if (digits != std::string::npos) {
+        char* unit = nullptr;
+        const double count = std::strtod(timescale.c_str() + digits, &unit);
+        while (*unit == ' ') {
+            unit++;
+        }
+        const std::string_view units[] = {"fs", "ps", "ns", "us", "ms", "s"};
+        const double scales[] = {1e-15, 1e-12, 1e-9, 1e-6, 1e-3, 1};
+        for (size_t i = 0; i < std::size(units); i++) {
+            if (std::string_view(unit).starts_with(units[i])) {
+                header.secondsPerTick = count * scales[i];
+                break;
+            }
+        }
+    }
+
+    auto find = [&](const std::string& name, size_t fallback) -> std::string {
+        for (const auto& [id, signalName] : signals) {
+            if (!name.empty() && signalName == name) {
+                return id;
+            }
+        }
+        return name.empty() && fallback < signals.size() ? signals[fallback].first : "";
+    };
+    header.aId = find(options.aName, 0);
+    header.bId = find(options.bName, 1);
+    return !header.aId.empty() && !header.bId.empty() && header.aId != header.bId;
+}
+
+// Which pin a value change line is for, -1 if neither
+// "0!", "1!", "x!" (x and z come back as -1 too)
+auto vcdChange(std::string_view line, const VcdHeader& header, int& level) -> int {
+    if (line.size() < 2 || (line[0] != '0' && line[0] != '1')) {
+        return -1;
+    }
+    level = line[0] - '0';
+    const std::string_view id = line.substr(1);
+    if (id == header.aId) {
+        return 0;
+    }
+    return id == header.bId ? 1 : -1;
+}
+
+// "pins" is the state at the chunk start or -1, returns the state the chunk
+// ended in
+auto analyzeVcd(const VcdHeader& header, Analyzer& analyzer, ChunkResult& chunk, int pins) -> void {
+    // A chunk's pins come from the first change of each: a change to 1
+    // means it was 0. Only changes are written, so this holds.
+    int known = 0;
+    if (pins < 0) {
+        pins = 0;
+        if (chunk.begin != header.body) {
+            forEachLine(chunk.begin, chunk.end, [&](std::string_view line) {
+                int level = 0;
+                const int pin = vcdChange(line, header, level);
+                if (pin >= 0 && (known & (1 << pin)) == 0) {
+                    known |= 1 << pin;
+                    pins |= level == 0 ? 1 << pin : 0;
+                }
+                return known != 3;
+            });
+            if (known != 3) {
+                chunk.unresolved = true;
+                return;
+            }
+        }
+    } else {
+        known = 3;
+    }
+    if (known == 3) {
+        analyzer.prime(pins);
+    }
+
+    // Changes at the same time are applied together, so A and B changing
+    // at once is seen as the skipped state it is
+    double t = 0;
+    int next = pins;
+    int nextKnown = known;
+    auto flush = [&]() {
+        if (nextKnown == 3) {
+            analyzer.sample(t, next);
+        }
+        known = nextKnown;
+    };
+    forEachLine(chunk.begin, chunk.end, [&](std::string_view line) {
+        if (line.empty()) {
+            return true;
+        }
+        if (line.front() == '#') {
+            flush();
+            line.remove_prefix(1);
+            uint64_t ticks = 0;
+            if (parseNumber(line, ticks)) {
+                t = static_cast<double>(ticks) * header.secondsPerTick;
+            }
+            return true;
+        }
+        int level = 0;
+        const int pin = vcdChange(line, header, level);
+        if (pin >= 0) {
+            next = (next & ~(1 << pin)) | (level << pin);
+            nextKnown |= 1 << pin;
+        }
+        return true;
+    });
+    flush();
+}
+
+// Reading the file ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    auto open(const std::string& path) -> bool {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info {};
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(info.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+        return true;
+    }
+};
+
+// Cuts [begin, end) into about "count" chunks. VCD chunks start at a
+// timestamp so the changes after it stay with it.
+auto makeChunks(const char* begin, const char* end, size_t count, bool atTimestamp) -> std::vector<ChunkResult> {
+    std::vector<ChunkResult> chunks;
+    const auto size = static_cast<size_t>(end - begin);
+    const char* start = begin;
+    for (size_t i = 1; i <= count && start < end; i++) {
+        const char* cut = i == count ? end : begin + size * i / count;
+        cut = std::max(cut, start);
+        while (cut < end && !(cut[-1] == '\n' && (!atTimestamp || *cut == '#'))) {
+            cut++;
+        }
+        if (cut > start) {
+            ChunkResult chunk;
+            chunk.begin = start;
+            chunk.end = cut;
+            chunks.push_back(std::move(chunk));
+        }
+        start = cut;
+    }
+    return chunks;
+}
+
+auto readProfile(const std::string& path, Profile& profile) -> bool {
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    double start = 0;
+    double rate = 0;
+    while (std::fscanf(file, "%lf %lf", &start, &rate) == 2) {
+        if (!profile.empty() && start < profile.starts.back()) {
+            std::fclose(file);
+            return false;
+        }
+        profile.add(start, rate);
+    }
+    std::fclose(file);
+    return !profile.empty();
+}
+
+auto formatName(Format format) -> const char* {
+    switch (format) {
+    case Format::sim:
+        return "sim";
+    case Format::csv:
+        return "csv";
+    case Format::vcd:
+        return "vcd";
+    }
+    return "?";
+}
+
+auto parseOptions(int argc, char** argv, Options& options) -> bool {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--format" && hasValue) {
+            const std::string value = argv[++i];
+            options.formatGiven = true;
+            if (value == "sim") {
+                options.format = Format::sim;
+            } else if (value == "csv") {
+                options.format = Format::csv;
+            } else if (value == "vcd") {
+                options.format = Format::vcd;
+            } else {
+                return false;
+            }
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = std::atof(argv[++i]);
+            options.haveRate = true;
+        } else if (arg == "--profile" && hasValue) {
+            options.profileFile = argv[++i];
+        } else if (arg == "--time-scale" && hasValue) {
+            options.timeScale = std::atof(argv[++i]);
+        } else if (arg == "--a" && hasValue) {
+            options.aName = argv[++i];
+        } else if (arg == "--b" && hasValue) {
+            options.bName = argv[++i];
+        } else if (arg == "--a-col" && hasValue) {
+            options.aColumn = std::atoi(argv[++i]);
+        } else if (arg == "--b-col" && hasValue) {
+            options.bColumn = std::atoi(argv[++i]);
+        } else if (arg == "--spectrum" && hasValue) {
+            options.spectrumFile = argv[++i];
+        } else if (options.file.empty() && !arg.starts_with("--")) {
+            options.file = arg;
+        } else {
+            return false;
+        }
+    }
+    if (!options.formatGiven) {
+        if (options.file.ends_with(".vcd")) {
+            options.format = Format::vcd;
+        } else if (options.file.ends_with(".csv")) {
+            options.format = Format::csv;
+        }
+    }
+    return !options.file.empty() && options.aColumn >= 1 && options.bColumn >= 1
+           && options.aColumn != options.bColumn;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr,
+                     "usage: %s FILE [--format sim|csv|vcd] [--threads N] [--rate N | --profile FILE]\n"
+                     "       [--time-scale X] [--a NAME] [--b NAME] [--a-col N] [--b-col N] [--spectrum FILE]\n",
+                     argv[0]);
+        return 2;
+    }
+    Profile profile;
+    if (!options.profileFile.empty() && !readProfile(options.profileFile, profile)) {
+        std::fprintf(stderr, "can't read the profile %s\n", options.profileFile.c_str());
+        return 2;
+    }
+    if (options.haveRate && profile.empty()) {
+        profile.add(0, options.rate);
+    }
+    MappedFile file;
+    if (!file.open(options.file)) {
+        std::fprintf(stderr, "can't map %s\n", options.file.c_str());
+        return 2;
+    }
+    const char* begin = file.data;
+    const char* end = file.data + file.size;
+    VcdHeader header;
+    if (options.format == Format::vcd) {
+        if (!parseVcdHeader(begin, end, options, header)) {
+            std::fprintf(stderr, "no $enddefinitions, or no A and B signals in %s\n", options.file.c_str());
+            return 2;
+        }
+        header.body = std::min(header.body, end);
+        begin = header.body;
+    }
+
+    const unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<ChunkResult> chunks =
+        makeChunks(begin, end, threads * CHUNKS_PER_THREAD, options.format == Format::vcd);
+    const auto started = std::chrono::steady_clock::now();
+
+    auto analyze = [&](ChunkResult& chunk, int pins) {
+        Analyzer analyzer(profile, chunk);
+        switch (options.format) {
+        case Format::sim:
+            analyzeSim(file.data, analyzer, chunk);
+            break;
+        case Format::csv:
+            analyzeCsv(file.data, options, analyzer, chunk);
+            break;
+        case Format::vcd:
+            analyzeVcd(header, analyzer, chunk, pins);
+            break;
+        }
+        analyzer.finish();
+    };
+    std::atomic<size_t> nextChunk{0};
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            for (size_t at = nextChunk++; at < chunks.size(); at = nextChunk++) {
+                analyze(chunks[at], -1);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // Merge in file order
+    ChunkResult total;
+    total.power.assign(SEGMENT / 2 + 1, 0);
+    bool haveLast = false;
+    double lastEdge = 0;
+    int lastState = -1;
+    for (ChunkResult& chunk : chunks) {
+        if (chunk.unresolved) {
+            // A VCD chunk where a pin never changed: it kept the level the
+            // chunk before ended with
+            const ChunkResult saved = chunk;
+            chunk = ChunkResult();
+            chunk.begin = saved.begin;
+            chunk.end = saved.end;
+            if (lastState >= 0) {
+                analyze(chunk, lastState);
+            }
+        }
+        if (haveLast && chunk.haveEdge && !chunk.brokenBeforeFirstEdge) {
+            total.interval.add(chunk.firstEdge - lastEdge);
+        }
+        if (chunk.haveEdge) {
+            haveLast = true;
+            lastEdge = chunk.lastEdge;
+        }
+        if (chunk.endState >= 0) {
+            lastState = chunk.endState;
+        }
+        total.driftMin = std::min(total.driftMin, static_cast<double>(total.net) + chunk.driftMin);
+        total.driftMax = std::max(total.driftMax, static_cast<double>(total.net) + chunk.driftMax);
+        if (!total.haveEdge && chunk.haveEdge) {
+            total.haveEdge = true;
+            total.firstEdge = chunk.firstEdge;
+        }
+        total.lastEdge = chunk.haveEdge ? chunk.lastEdge : total.lastEdge;
+        total.edges += chunk.edges;
+        total.illegal += chunk.illegal;
+        total.net += chunk.net;
+        total.interval.merge(chunk.interval);
+        total.phase.merge(chunk.phase);
+        for (size_t k = 0; k < total.power.size() && k < chunk.power.size(); k++) {
+            total.power[k] += chunk.power[k];
+        }
+        total.segments += chunk.segments;
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::printf("file      %s (%s, %.1f MB, %u threads, %zu chunks, %.2f s, %.0f MB/s)\n", options.file.c_str(),
+                formatName(options.format), static_cast<double>(file.size) / 1e6, threads, chunks.size(), seconds,
+                static_cast<double>(file.size) / 1e6 / std::max(seconds, 1e-9));
+    std::printf("edges     %llu, net %+lld, %llu illegal transitions\n",
+                static_cast<unsigned long long>(total.edges), static_cast<long long>(total.net),
+                static_cast<unsigned long long>(total.illegal));
+    if (!total.haveEdge || total.interval.count == 0) {
+        std::printf("not enough edges to say more\n");
+        return total.illegal == 0 ? 0 : 1;
+    }
+    const double span = total.lastEdge - total.firstEdge;
+    std::printf("span      %.6f s, %.1f edges/s\n", span, static_cast<double>(total.interval.count) / span);
+    std::printf("interval  mean %.3f us, sd %.3f us, min %.3f us, max %.3f us\n", total.interval.mean * 1e6,
+                total.interval.deviation() * 1e6, total.interval.min * 1e6, total.interval.max * 1e6);
+    if (total.phase.count != 0) {
+        std::printf("B phase   %+.2f deg from 90 (sd %.2f, min %+.2f, max %+.2f)\n", total.phase.mean,
+                    total.phase.deviation(), total.phase.min, total.phase.max);
+    }
+    if (!profile.empty()) {
+        size_t piece = 0;
+        const double finalDrift = static_cast<double>(total.net) - profile.expected(total.lastEdge, piece);
+        std::printf("drift     %+.1f edges at the end, %+.1f to %+.1f on the way\n", finalDrift, total.driftMin,
+                    total.driftMax);
+    }
+
+    // Jitter spectrum: the intervals are samples one edge apart, the mean
+    // edge rate makes that Hz. A bin's value is the rms of a sine in the
+    // interval at that frequency (Hann window gain taken out). The last
+    // bin (half the edge rate: long, short, long...) and the first don't
+    // share their line with a mirror bin like the others, so they take
+    // sqrt(2) less.
+    if (total.segments != 0) {
+        const double edgeRate = 1 / total.interval.mean;
+        const size_t last = total.power.size() - 1;
+        auto rmsUs = [&](size_t k) {
+            const double scale = k == 0 || k == last ? 2 : 2 * std::numbers::sqrt2;
+            return std::sqrt(total.power[k] / static_cast<double>(total.segments)) * scale
+                   / static_cast<double>(SEGMENT) * 1e6;
+        };
+        auto hz = [&](size_t k) {
+            return static_cast<double>(k) * edgeRate / static_cast<double>(SEGMENT);
+        };
+        // Only lines that stand NOISE_FLOOR times out of the median bin
+        std::vector<double> floor;
+        for (size_t k = 1; k <= last; k++) {
+            floor.push_back(rmsUs(k));
+        }
+        std::nth_element(floor.begin(), floor.begin() + static_cast<ptrdiff_t>(floor.size() / 2), floor.end());
+        const double floorUs = floor[floor.size() / 2] * NOISE_FLOOR;
+        std::vector<size_t> peaks;
+        for (size_t k = 1; k <= last; k++) {
+            if (total.power[k] > total.power[k - 1] && (k == last || total.power[k] >= total.power[k + 1])
+                && rmsUs(k) > floorUs) {
+                peaks.push_back(k);
+            }
+        }
+        std::sort(peaks.begin(), peaks.end(), [&](size_t a, size_t b) { return rmsUs(a) > rmsUs(b); });
+        std::printf("jitter    %llu segments of %zu edges, strongest lines:\n",
+                    static_cast<unsigned long long>(total.segments), SEGMENT);
+        for (size_t i = 0; i < peaks.size() && i < 5; i++) {
+            std::printf("          %10.3f Hz  %.3f us rms\n", hz(peaks[i]), rmsUs(peaks[i]));
+        }
+        if (!options.spectrumFile.empty()) {
+            FILE* out = std::fopen(options.spectrumFile.c_str(), "w");
+            if (out == nullptr) {
+                std::fprintf(stderr, "can't write %s\n", options.spectrumFile.c_str());
+                return 2;
+            }
+            for (size_t k = 0; k < total.power.size(); k++) {
+                std::fprintf(out, "%.6f,%.6f\n", hz(k), rmsUs(k));
+            }
+            std::fclose(out);
+        }
+    }
+    return total.illegal == 0 ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+// Waveforms as VCD files, for a real waveform viewer instead of the
+// little plot on the Free-Wili
+//
+// Two sources:
+//  - a flight recorder dump from the device (TRACE_FILE, or the UART
+//    lines of a dump saved to a file), see recorder.h. The pins come from
+//    the positions, the events become markers, a freeze shows its reason.
+//  - a simulated run: the engine and the app's edge rule on the stub in
+//    device time (fwwasm_stub.h, device_costs.h). The pins are what setIO
+//    wrote, the markers are missed deadlines (same rule as the app) and
+//    direction changes.
+// Markers are pulses with the value they came with on a bus next to them.
+// Everything goes through VcdWriter, so millions of edges take seconds.
+//
+//   vcd_export --log FILE [-o OUT]
+//   vcd_export --simulate [--edges N] [--rate-ms N] [--gui-ms N]
+//              [--reverse-every N] [--scale NM SPACING] [--costs FILE] [-o OUT]
+//
+// OUT is stdout if not given. Both are in us, log times only have ms in
+// them.
+
+#include "encoder_engine.h"
+#include "fwwasm_stub.h"
+#include "linear_scale.h"
+#include "recorder.h"
+#include "vcd_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Same as quadrature.cpp
+const int PinA = 13;
+const int PinB = 27;
+const int PinIndex = 26;
+const unsigned MISSED_DEADLINE_MIN_MS = 2;
+
+// Pins for a position, by position & 3 (nextStateTable order)
+const int STATE_A[4] = {0, 1, 1, 0};
+const int STATE_B[4] = {0, 0, 1, 1};
+
+// A marker stays up this long (us), then goes back down
+const uint64_t MARKER_US = 200;
+
+// Marker pulses that still have to go back down, in the order they went
+// up. All writes go through here so the pulses end in time order.
+class Markers {
+public:
+    explicit Markers(VcdWriter& vcd) : vcd(vcd) {}
+
+    auto change(uint64_t time, int signal, uint64_t value) -> void {
+        lowerUntil(time);
+        vcd.change(time, signal, value);
+    }
+
+    auto pulse(uint64_t time, int signal) -> void {
+        change(time, signal, 1);
+        pending.push_back({time + MARKER_US, signal});
+    }
+
+    auto lowerUntil(uint64_t time) -> void {
+        size_t done = 0;
+        while (done < pending.size() && pending[done].at <= time) {
+            vcd.change(pending[done].at, pending[done].signal, 0);
+            done++;
+        }
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(done));
+    }
+
+    auto finish(uint64_t time) -> void {
+        lowerUntil(UINT64_MAX);
+        vcd.finish(time + MARKER_US);
+    }
+
+private:
+    struct Low {
+        uint64_t at;
+        int signal;
+    };
+
+    VcdWriter& vcd;
+    std::vector<Low> pending;
+};
+
+struct Summary {
+    uint64_t edges = 0;
+    uint64_t markers = 0;
+    uint64_t endUs = 0;
+};
+
+// Flight recorder dump lines: "R <reason> <frozen at ms> <blocks>",
+// "E <ms> <position>", "V <ms> <kind> <value>", "Z"
+auto export_log(FILE* in, VcdWriter& vcd) -> Summary {
+    const int a = vcd.signal("A", 1);
+    const int b = vcd.signal("B", 1);
+    const int position = vcd.signal("position", 32);
+    const int freeze = vcd.signal("freeze_reason", 2);
+    const int miss = vcd.signal("deadline_miss", 1);
+    const int lateMs = vcd.signal("late_ms", 32);
+    const int button = vcd.signal("button", 1);
+    const int buttonEvent = vcd.signal("button_event", 8);
+    const int command = vcd.signal("command", 1);
+    const int commandAction = vcd.signal("command_action", 8);
+    const int mismatch = vcd.signal("mismatch", 1);
+    const int mismatchCounts = vcd.signal("mismatch_counts", 32);
+    const int mark = vcd.signal("mark", 1);
+    const int markValue = vcd.signal("mark_value", 32);
+    const int preset = vcd.signal("preset", 1);
+    Markers markers(vcd);
+    Summary summary;
+
+    // A dump from before a reboot can have later times than the next one,
+    // every dump is moved to start at least 1ms after the last one ended,
+    // so the last one's freeze shows
+    uint64_t offsetUs = 0;
+    uint64_t lastUs = 0;
+    bool dumpStarted = false;
+    uint32_t frozenAtMs = 0;
+    int frozenReason = 0;
+    // A preset changes the count but not the pins, from then on the pins
+    // are pinShift further on than the position says. A dump starts with
+    // them in step, it doesn't say where they were.
+    uint32_t lastPosition = 0;
+    uint32_t pinShift = 0;
+    auto at = [&](long long ms) {
+        uint64_t us = static_cast<uint64_t>(ms) * 1000 + offsetUs;
+        if (!dumpStarted) {
+            dumpStarted = true;
+            if (lastUs != 0 && us < lastUs + 1000) {
+                offsetUs += lastUs + 1000 - us;
+                us = lastUs + 1000;
+            }
+            // A new dump, the last freeze is over
+            markers.change(us, freeze, 0);
+            pinShift = 0;
+        }
+        lastUs = std::max(lastUs, us);
+        return lastUs;
+    };
+    auto pins = [&](uint64_t us, int32_t to) {
+        lastPosition = static_cast<uint32_t>(to);
+        const auto state = static_cast<size_t>((lastPosition + pinShift) & 3);
+        markers.change(us, a, static_cast<uint64_t>(STATE_A[state]));
+        markers.change(us, b, static_cast<uint64_t>(STATE_B[state]));
+        markers.change(us, position, lastPosition);
+    };
+    auto endDump = [&]() {
+        if (dumpStarted) {
+            const uint64_t us = std::max(lastUs, static_cast<uint64_t>(frozenAtMs) * 1000 + offsetUs);
+            markers.change(us, freeze, static_cast<uint64_t>(frozenReason));
+            lastUs = us;
+        }
+        dumpStarted = false;
+    };
+
+    char line[256];
+    while (std::fgets(line, sizeof(line), in) != nullptr) {
+        long long ms = 0;
+        long long first = 0;
+        long long second = 0;
+        switch (line[0]) {
+        case 'R':
+            endDump();
+            if (std::sscanf(line + 1, "%lld %lld", &first, &second) == 2) {
+                frozenReason = static_cast<int>(first);
+                frozenAtMs = static_cast<uint32_t>(second);
+            }
+            break;
+        case 'Z':
+            endDump();
+            break;
+        case 'E':
+            if (std::sscanf(line + 1, "%lld %lld", &ms, &first) == 2) {
+                pins(at(ms), static_cast<int32_t>(first));
+                summary.edges++;
+            }
+            break;
+        case 'V':
+            if (std::sscanf(line + 1, "%lld %lld %lld", &ms, &first, &second) == 3) {
+                const uint64_t us = at(ms);
+                const auto value = static_cast<uint32_t>(static_cast<int32_t>(second));
+                summary.markers++;
+                switch (static_cast<RecordKind>(first)) {
+                case RecordKind::deadlineMiss:
+                    markers.change(us, lateMs, value);
+                    markers.pulse(us, miss);
+                    break;
+                case RecordKind::button:
+                    markers.change(us, buttonEvent, value & 0xFF);
+                    markers.pulse(us, button);
+                    break;
+                case RecordKind::command:
+                    markers.change(us, commandAction, value & 0xFF);
+                    markers.pulse(us, command);
+                    break;
+                case RecordKind::mismatch:
+                    markers.change(us, mismatchCounts, value);
+                    markers.pulse(us, mismatch);
+                    break;
+                case RecordKind::preset:
+                    pinShift += lastPosition - value;
+                    lastPosition = value;
+                    markers.change(us, position, value);
+                    markers.pulse(us, preset);
+                    break;
+                default:
+                    markers.change(us, markValue, value);
+                    markers.pulse(us, mark);
+                    break;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    endDump();
+    summary.endUs = lastUs;
+    markers.finish(lastUs);
+    return summary;
+}
+
+struct SimulateOptions {
+    uint64_t edges = 100000;
+    unsigned rateMs = 1;
+    unsigned guiMs = 1;
+    uint64_t reverseEvery = 0;
+    uint32_t scaleNm = 0;
+    int32_t scaleSpacing = 0;
+};
+
+// The app's main loop as far as the pins go, on the stub in device time
+auto export_simulation(const SimulateOptions& options, const DeviceCosts& costs, VcdWriter& vcd) -> Summary {
+    const int a = vcd.signal("A", 1);
+    const int b = vcd.signal("B", 1);
+    const int index = vcd.signal("index", 1);
+    const int direction = vcd.signal("direction", 1);
+    const int miss = vcd.signal("deadline_miss", 1);
+    const int lateMs = vcd.signal("late_ms", 32);
+    Markers markers(vcd);
+    Summary summary;
+
+    stub::useDeviceCosts(costs);
+    stub::setPinWatcher([&](int io, int level, int64_t atNs) {
+        const int signal = io == PinA ? a : io == PinB ? b : io == PinIndex ? index : -1;
+        if (signal >= 0) {
+            markers.change(static_cast<uint64_t>(atNs / 1000), signal, static_cast<uint64_t>(level));
+        }
+    });
+    auto nowUs = []() { return static_cast<uint64_t>(stub::deviceNs() / 1000); };
+
+    QuadratureEngine engine;
+    LinearScale scale;
+    if (options.scaleNm != 0) {
+        scale.configure(options.scaleNm, options.scaleSpacing, 0);
+        engine.countRevolutions = false;
+    }
+    bool indexUp = false;
+    markers.change(0, a, 0);
+    markers.change(0, b, 0);
+    markers.change(0, index, 0);
+    markers.change(0, direction, 1);
+    engine.sensorRefreshRate = options.rateMs;
+    engine.stopSimulation = false;
+    engine.sensorOldMillis = millis();
+    unsigned int guiOldMillis = 0;
+
+    while (summary.edges < options.edges) {
+        waitms(1);
+        stub::chargeLoop();
+        if (engine.due(millis())) {
+            const uint32_t edgeMillis = engine.sensorOldMillis;
+            const unsigned int edgeNow = millis();
+            if (indexUp) {
+                indexUp = false;
+                setIO(PinIndex, 0);
+            }
+            stub::chargeEdge();
+            engine.step(engine.direction);
+            setIO(PinA, engine.sensorState[0]);
+            setIO(PinB, engine.sensorState[1]);
+            if (scale.enabled && scale.edge(engine.transitionCount)) {
+                indexUp = true;
+                setIO(PinIndex, 1);
+            }
+            summary.edges++;
+
+            const unsigned int lateness = edgeNow - edgeMillis;
+            if (lateness >= engine.sensorRefreshRate && lateness >= MISSED_DEADLINE_MIN_MS) {
+                markers.change(nowUs(), lateMs, lateness);
+                markers.pulse(nowUs(), miss);
+                summary.markers++;
+            }
+            engine.sensorOldMillis = edgeNow + engine.sensorRefreshRate;
+            if (options.reverseEvery != 0 && summary.edges % options.reverseEvery == 0) {
+                engine.direction = !engine.direction;
+                markers.change(nowUs(), direction, static_cast<uint64_t>(engine.direction));
+                summary.markers++;
+            }
+        }
+        const unsigned int nowMs = millis();
+        if (nowMs - guiOldMillis >= options.guiMs) {
+            guiOldMillis = nowMs;
+            setControlValue(0, 0, engine.transitionCount);
+            setControlValue(0, 0, engine.totalRefs);
+            setPlotData(1, 1, engine.sensorState[0]);
+            setPlotData(0, 1, engine.sensorState[1]);
+        }
+        (void)UARTDataRxCount();
+        (void)hasEvent();
+    }
+    stub::setPinWatcher(nullptr);
+    summary.endUs = nowUs();
+    markers.finish(summary.endUs);
+    return summary;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    std::string logFile;
+    std::string outFile;
+    std::string costsFile;
+    bool simulate = false;
+    SimulateOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--log" && hasValue) {
+            logFile = argv[++i];
+        } else if (arg == "--simulate") {
+            simulate = true;
+        } else if (arg == "-o" && hasValue) {
+            outFile = argv[++i];
+        } else if (arg == "--costs" && hasValue) {
+            costsFile = argv[++i];
+        } else if (arg == "--edges" && hasValue) {
+            options.edges = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--rate-ms" && hasValue) {
+            options.rateMs = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--gui-ms" && hasValue) {
+            options.guiMs = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--reverse-every" && hasValue) {
+            options.reverseEvery = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--scale" && i + 2 < argc) {
+            options.scaleNm = static_cast<uint32_t>(std::atoi(argv[++i]));
+            options.scaleSpacing = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s --log FILE [-o OUT]\n"
+                         "       %s --simulate [--edges N] [--rate-ms N] [--gui-ms N] [--reverse-every N]\n"
+                         "          [--scale NM SPACING] [--costs FILE] [-o OUT]\n",
+                         argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (simulate == !logFile.empty()) {
+        std::fprintf(stderr, "give one of --log FILE or --simulate\n");
+        return 2;
+    }
+    if (options.rateMs < 1 || options.guiMs < 1) {
+        std::fprintf(stderr, "rate-ms and gui-ms have to be at least 1\n");
+        return 2;
+    }
+    if (options.scaleNm != 0 && !LinearScale().configure(options.scaleNm, options.scaleSpacing, 0)) {
+        std::fprintf(stderr, "that isn't a scale the app takes\n");
+        return 2;
+    }
+    DeviceCosts costs;
+    if (!costsFile.empty() && !costs.load(costsFile.c_str())) {
+        std::fprintf(stderr, "can't use the costs in %s\n", costsFile.c_str());
+        return 2;
+    }
+
+    FILE* in = nullptr;
+    if (!simulate) {
+        in = std::fopen(logFile.c_str(), "r");
+        if (in == nullptr) {
+            std::fprintf(stderr, "can't read %s\n", logFile.c_str());
+            return 2;
+        }
+    }
+    FILE* out = outFile.empty() ? stdout : std::fopen(outFile.c_str(), "wb");
+    if (out == nullptr) {
+        std::fprintf(stderr, "can't write %s\n", outFile.c_str());
+        return 2;
+    }
+
+    const auto started = std::chrono::steady_clock::now();
+    Summary summary;
+    {
+        VcdWriter vcd(out, "1 us");
+        summary = simulate ? export_simulation(options, costs, vcd) : export_log(in, vcd);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (in != nullptr) {
+        std::fclose(in);
+    }
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    std::fprintf(stderr, "%llu edges, %llu markers, %.3f s of waveform in %.2f s\n",
+                 static_cast<unsigned long long>(summary.edges), static_cast<unsigned long long>(summary.markers),
+                 static_cast<double>(summary.endUs) / 1e6, seconds);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Streaming Value Change Dump writer
+//
+// Declare the signals, then hand over changes in time order. Everything
+// is formatted by hand into one large buffer that goes out in big
+// fwrite()s, so millions of edges take seconds, and only a change that
+// really changes a signal is written. The files open in GTKWave, PulseView
+// and the other waveform viewers, and trace_analyzer reads them back.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class VcdWriter {
+public:
+    static constexpr size_t BUFFER_BYTES = 1 << 20;
+
+    // timescale is the VCD unit, "1 us", "1 ms", ...
+    VcdWriter(FILE* out, const char* timescale) : out(out), timescale(timescale) {
+        buffer.reserve(BUFFER_BYTES + 64);
+    }
+
+    VcdWriter(const VcdWriter&) = delete;
+    auto operator=(const VcdWriter&) -> VcdWriter& = delete;
+
+    ~VcdWriter() {
+        flush();
+    }
+
+    // A signal "bits" wide, returns what to pass to change()
+    // All of them have to be declared before the first change
+    auto signal(const char* name, int bits) -> int {
+        Signal added;
+        added.name = name;
+        added.bits = bits;
+        // Identifiers are printable characters, base 94 from '!'
+        for (size_t number = signals.size();; number = number / 94 - 1) {
+            added.id.push_back(static_cast<char>('!' + number % 94));
+            if (number < 94) {
+                break;
+            }
+        }
+        signals.push_back(added);
+        return static_cast<int>(signals.size() - 1);
+    }
+
+    // Sets a signal from "time" on, times must not go backwards
+    auto change(uint64_t time, int index, uint64_t value) -> void {
+        if (!started) {
+            start();
+        }
+        Signal& target = signals[static_cast<size_t>(index)];
+        if (target.known && target.value == value) {
+            return;
+        }
+        target.known = true;
+        target.value = value;
+        if (time != now || !timeWritten) {
+            now = time;
+            timeWritten = true;
+            put('#');
+            putNumber(time);
+            put('\n');
+        }
+        if (target.bits == 1) {
+            put(value != 0 ? '1' : '0');
+        } else {
+            put('b');
+            int top = target.bits - 1;
+            while (top > 0 && ((value >> top) & 1) == 0) {
+                top--;
+            }
+            for (int bit = top; bit >= 0; bit--) {
+                put(((value >> bit) & 1) != 0 ? '1' : '0');
+            }
+            put(' ');
+        }
+        putText(target.id);
+        put('\n');
+        if (buffer.size() >= BUFFER_BYTES) {
+            flush();
+        }
+    }
+
+    // Ends the dump at "time", so the last values show for a while
+    auto finish(uint64_t time) -> void {
+        if (!started) {
+            start();
+        }
+        if (time > now || !timeWritten) {
+            put('#');
+            putNumber(time);
+            put('\n');
+            now = time;
+            timeWritten = true;
+        }
+        flush();
+    }
+
+    auto flush() -> void {
+        if (!buffer.empty()) {
+            std::fwrite(buffer.data(), 1, buffer.size(), out);
+            buffer.clear();
+        }
+    }
+
+private:
+    struct Signal {
+        std::string name;
+        std::string id;
+        int bits = 1;
+        bool known = false;
+        uint64_t value = 0;
+    };
+
+    // The header, the signals go in as wires of one module
+    auto start() -> void {
+        started = true;
+        putText("$timescale ");
+        putText(timescale);
+        putText(" $end\n$scope module encoder $end\n");
+        for (const Signal& declared : signals) {
+            putText("$var wire ");
+            putNumber(static_cast<uint64_t>(declared.bits));
+            put(' ');
+            putText(declared.id);
+            put(' ');
+            putText(declared.name);
+            putText(" $end\n");
+        }
+        putText("$upscope $end\n$enddefinitions $end\n");
+    }
+
+    auto put(char c) -> void {
+        buffer.push_back(c);
+    }
+
+    auto putText(const std::string& text) -> void {
+        buffer.insert(buffer.end(), text.begin(), text.end());
+    }
+
+    auto putNumber(uint64_t number) -> void {
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + number % 10);
+            number /= 10;
+        } while (number != 0);
+        while (count > 0) {
+            put(digits[--count]);
+        }
+    }
+
+    FILE* out;
+    std::string timescale;
+    std::vector<Signal> signals;
+    std::vector<char> buffer;
+    bool started = false;
+    bool timeWritten = false;
+    uint64_t now = 0;
+};
@@ -0,0 +1,175 @@
+// Checks the random walk soak mode the way the app runs it
+//
+// Runs RandomWalk (random_walk.h) through random_walk() in quadrature.cpp
+// and the main loop's edge rule, one 1ms loop at a time on a virtual
+// clock, for many seeds and hours of walking each. The walk only counts
+// if the generator can't be what makes a count error, so every run has to:
+//  - never put two edges closer than the 1/4 period of the max rate
+//  - never leave the position window
+//  - end with the engine's count where the edges say it is
+//
+//   walk_check [--seeds N] [--hours N] [--walk MAX_RATE ACCEL LOW HIGH]
+//
+// Without --walk a few walks from flat out to slow, in wide and tight
+// windows, are checked.
+
+#include "encoder_engine.h"
+#include "random_walk.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint64_t MS_PER_HOUR = 60 * 60 * 1000;
+
+// The "W" line without the seed
+struct Walk {
+    int32_t maxRate;
+    int32_t maxAccel;
+    int32_t low;
+    int32_t high;
+};
+
+const std::vector<Walk> WALKS = {
+    {1000, 100, -100000, 100000},
+    {1000, 1000, -5000, 5000},
+    {500, 50, -100000, 100000},
+    {500, 10, -4000, 4000},
+    {333, 333, -1000, 1000},
+    {50, 5, -200, 200},
+    {1, 1, -10, 10},
+};
+
+struct Result {
+    uint64_t edges = 0;
+    uint32_t minGapMs = UINT32_MAX;
+    int64_t lowest = 0;
+    int64_t highest = 0;
+    bool countOk = true;
+};
+
+// One walk from a standstill at 0 for "ms", the app's way:
+//  - every WALK_UPDATE_MS the walk gives a velocity, that's the 1/4
+//    period (rounded up) and direction, stopping is just stopping
+//  - going again after a stop, the next edge is still a whole 1/4
+//    period after the last one
+//  - an edge goes out on the first loop it's due and the next one is
+//    due a 1/4 period after that loop
+auto run_walk(const Walk& walk, uint32_t seed, uint64_t ms) -> Result {
+    RandomWalk random;
+    random.configure(seed, walk.maxRate, walk.maxAccel, walk.low, walk.high);
+    QuadratureEngine engine;
+    engine.stopSimulation = true;
+    Result result;
+    int64_t position = 0;
+    bool haveEdge = false;
+    uint32_t lastEdgeMs = 0;
+    for (uint32_t nowMs = 0; nowMs < ms; nowMs++) {
+        if (nowMs % WALK_UPDATE_MS == 0) {
+            const int32_t velocity = random.update(engine.transitionCount);
+            const uint32_t rateMs = RandomWalk::rateMs(velocity);
+            if (rateMs == 0) {
+                engine.stopSimulation = true;
+            } else {
+                engine.direction = velocity > 0 ? 1 : 0;
+                engine.sensorRefreshRate = rateMs;
+                if (engine.stopSimulation) {
+                    engine.stopSimulation = false;
+                    if (engine.due(nowMs)) {
+                        engine.sensorOldMillis = nowMs;
+                    }
+                }
+            }
+        }
+        if (engine.due(nowMs)) {
+            engine.step(engine.direction);
+            engine.sensorOldMillis = nowMs + engine.sensorRefreshRate;
+            position += engine.direction != 0 ? 1 : -1;
+            result.edges++;
+            if (haveEdge && nowMs - lastEdgeMs < result.minGapMs) {
+                result.minGapMs = nowMs - lastEdgeMs;
+            }
+            haveEdge = true;
+            lastEdgeMs = nowMs;
+            result.lowest = position < result.lowest ? position : result.lowest;
+            result.highest = position > result.highest ? position : result.highest;
+        }
+    }
+    result.countOk = engine.transitionCount == static_cast<int>(position);
+    return result;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    uint32_t seeds = 20;
+    uint64_t hours = 2;
+    std::vector<Walk> walks = WALKS;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--seeds" && i + 1 < argc) {
+            seeds = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "--hours" && i + 1 < argc) {
+            hours = static_cast<uint64_t>(std::atoll(argv[++i]));
+        } else if (arg == "--walk" && i + 4 < argc) {
+            walks = {{std::atoi(argv[i + 1]), std::atoi(argv[i + 2]), std::atoi(argv[i + 3]), std::atoi(argv[i + 4])}};
+            i += 4;
+        } else {
+            std::fprintf(stderr, "usage: %s [--seeds N] [--hours N] [--walk MAX_RATE ACCEL LOW HIGH]\n", argv[0]);
+            return 2;
+        }
+    }
+    // Past 49 days the loop's clock would wrap, soak_sim covers that
+    if (seeds < 1 || hours < 1 || hours > 1000) {
+        std::fprintf(stderr, "seeds has to be at least 1, hours 1 to 1000\n");
+        return 2;
+    }
+
+    const auto started = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (const Walk& walk : walks) {
+        RandomWalk check;
+        if (!check.configure(1, walk.maxRate, walk.maxAccel, walk.low, walk.high)) {
+            std::printf("walk %d %d %d..%d: the app would refuse it\n", walk.maxRate, walk.maxAccel, walk.low,
+                        walk.high);
+            ok = false;
+            continue;
+        }
+        // The closest two edges may be, the 1/4 period at the max rate
+        const auto gapMs = static_cast<uint32_t>(RandomWalk::rateMs(walk.maxRate));
+        uint64_t edges = 0;
+        uint32_t minGapMs = UINT32_MAX;
+        int64_t lowest = 0;
+        int64_t highest = 0;
+        uint32_t failed = 0;
+        for (uint32_t seed = 1; seed <= seeds; seed++) {
+            // Spread out, neighbouring xorshift seeds start out alike
+            const uint32_t walkSeed = seed * 2654435761u;
+            const Result result = run_walk(walk, walkSeed, hours * MS_PER_HOUR);
+            edges += result.edges;
+            minGapMs = result.minGapMs < minGapMs ? result.minGapMs : minGapMs;
+            lowest = result.lowest < lowest ? result.lowest : lowest;
+            highest = result.highest > highest ? result.highest : highest;
+            if (result.minGapMs < gapMs || result.lowest < walk.low || result.highest > walk.high || !result.countOk) {
+                if (failed++ < 5) {
+                    std::printf("  seed %u: closest edges %u ms, window %lld..%lld, count %s\n", walkSeed,
+                                result.minGapMs, static_cast<long long>(result.lowest),
+                                static_cast<long long>(result.highest), result.countOk ? "ok" : "wrong");
+                }
+            }
+        }
+        std::printf("walk %4d edges/s %4d accel %7d..%-7d  %11llu edges, closest %u ms (%u allowed), "
+                    "went %lld..%lld  %s\n",
+                    walk.maxRate, walk.maxAccel, walk.low, walk.high, static_cast<unsigned long long>(edges),
+                    minGapMs, gapMs, static_cast<long long>(lowest), static_cast<long long>(highest),
+                    failed == 0 ? "ok" : "FAILED");
+        ok = ok && failed == 0;
+    }
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::printf("%u seeds of %llu h each in %.2f s\n%s\n", seeds, static_cast<unsigned long long>(hours), elapsed,
+                ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
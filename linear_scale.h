@@ -0,0 +1,114 @@
+// Linear scale with distance coded reference marks
+//
+// A rotary encoder has one index per revolution. A long linear scale
+// instead has reference marks whose spacing tells where they are, so a
+// controller only has to pass two of them to know the absolute position.
+// With a nominal spacing of N signal periods, mark pair k (k = 0, 1, ...)
+// is at
+//   A(k) = k * N                 (fixed marks)
+//   B(k) = k * N + N / 2 + 1 + k (moves one period further every pair)
+// in signal periods from the start of the scale. Going forwards, the
+// distance from A(k) to B(k) is N / 2 + 1 + k and from B(k) to A(k + 1)
+// it is N / 2 - 1 - k. The two ranges don't overlap, so a controller
+// that measures the distance d between two marks knows:
+//   d > N / 2: it went from A(k) to B(k), k = d - N / 2 - 1
+//   d < N / 2: it went from B(k) to A(k + 1), k = N / 2 - 1 - d
+// (the other way round going backwards). There are N / 2 - 1 pairs, with
+// N = 1000 and a 20 um period that's a scale of almost 10 m.
+//
+// Only the marks just above and just below the current position are kept,
+// they are worked out again when the position gets to one of them, so a
+// scale of any length costs the same few bytes and an edge between marks
+// costs two compares.
+//
+// Positions are in edges (4 per signal period) like the rest of the engine,
+// micrometres() converts for display.
+
+#pragma once
+
+#include <climits>
+#include <cstdint>
+
+struct LinearScale {
+    bool enabled = false;
+    uint32_t periodNm = 20000; // signal period
+    int32_t spacing = 1000; // N, in signal periods
+
+    // Nearest marks below and above the position, in edges, both the
+    // position when it's on a mark
+    int32_t markBelow = 0;
+    int32_t markAbove = 0;
+    int32_t marksPassed = 0;
+    int32_t lastMark = -1; // last mark passed, in edges, -1 if none
+
+    // Turns the linear scale on ("spacing" >= 8) and finds the marks around
+    // "position"
+    auto configure(uint32_t nm, int32_t periods, int32_t position) -> bool {
+        if (nm == 0 || periods < 8) {
+            return false;
+        }
+        enabled = true;
+        periodNm = nm;
+        spacing = periods;
+        marksPassed = 0;
+        lastMark = -1;
+        locate(position);
+        return true;
+    }
+
+    auto pairs() const -> int32_t {
+        return spacing / 2 - 1;
+    }
+
+    auto micrometres(int32_t position) const -> int64_t {
+        return static_cast<int64_t>(position) * periodNm / 4000;
+    }
+
+    // Called for every edge with the position after it
+    // Returns true if there's a reference mark here
+    auto edge(int32_t position) -> bool {
+        if (position > markBelow && position < markAbove) {
+            return false;
+        }
+        // Got to a mark or just left one
+        if (!locate(position)) {
+            return false;
+        }
+        marksPassed++;
+        lastMark = position;
+        return true;
+    }
+
+    // Finds the marks either side of "position", also for a jump without
+    // edges. Returns true if "position" is on a mark.
+    auto locate(int32_t position) -> bool {
+        // Marks closer than one pair away are in pairs k - 1 to k + 1
+        const int64_t pairEdges = static_cast<int64_t>(spacing) * 4;
+        const int64_t k = position >= 0 ? position / pairEdges : -1;
+        // Off the scale, nothing there
+        int64_t below = INT32_MIN;
+        int64_t above = INT32_MAX;
+        bool onMark = false;
+        for (int64_t pair = k - 1; pair <= k + 1; pair++) {
+            if (pair < 0 || pair >= pairs()) {
+                continue;
+            }
+            const int64_t a = pair * pairEdges;
+            const int64_t marks[2] = {a, a + (spacing / 2 + 1 + pair) * 4};
+            for (const int64_t mark : marks) {
+                if (mark < position && mark > below) {
+                    below = mark;
+                }
+                if (mark > position && mark < above) {
+                    above = mark;
+                }
+                if (mark == position) {
+                    onMark = true;
+                }
+            }
+        }
+        markBelow = onMark ? position : static_cast<int32_t>(below);
+        markAbove = onMark ? position : static_cast<int32_t>(above);
+        return onMark;
+    }
+};
@@ -0,0 +1,131 @@
+// Point to point move cycles: the usual production test of a counter
+//
+// "Move +distance, dwell, move back, dwell" over and over, and at the end
+// of every move the count has to be exactly where it should be. The run
+// itself is a sequence in quadrature.cpp, this is the move profile and
+// the tally of what came out.
+//
+// A move is a trapezoid in 1/4 periods: it starts at startMs, gets 1ms
+// faster every rampEdges edges down to cruiseMs, and slows down the same
+// way so the last edge comes startMs after the one before it. All integer,
+// the same for every move, so every move should take the same time from
+// its first edge to its last. The loop starts every 1/4 period when it
+// gets to the edge, so all of them come in a bit late and a move takes
+// longer than expectedMs(), how much is kept as the lateness. A move that
+// takes more than jitterMs longer or shorter than the one before it in
+// the same direction was held up by something (the GUI, the UART, a slow
+// DUT read), and is flagged.
+
+#pragma once
+
+#include "text_line.h"
+#include <cstdint>
+
+struct MoveProfile {
+    int32_t distance = 1000; // edges per move
+    uint16_t startMs = 10; // 1/4 period at both ends of a move
+    uint16_t cruiseMs = 2; // 1/4 period in the middle
+    uint16_t rampEdges = 20; // edges per 1ms step of the ramps
+
+    auto valid() const -> bool {
+        return distance >= 1 && cruiseMs >= 1 && startMs >= cruiseMs && rampEdges >= 1;
+    }
+
+    // 1/4 period from edge "edge" to the next one, edges counted from 1
+    auto rateAt(int32_t edge) const -> uint16_t {
+        const int32_t fromStart = edge - 1;
+        const int32_t fromEnd = distance - 1 - edge;
+        const int32_t steps = (fromStart < fromEnd ? fromStart : fromEnd) / rampEdges;
+        return static_cast<uint16_t>(startMs - steps > cruiseMs ? startMs - steps : cruiseMs);
+    }
+
+    // ms from the first edge of a move to its last, with no hold ups
+    // Only the ramps are added up one by one, the middle is all cruiseMs
+    auto expectedMs() const -> uint32_t {
+        const int32_t intervals = distance - 1;
+        const int32_t ramp = (startMs - cruiseMs) * rampEdges;
+        const int32_t headEnd = ramp < intervals ? ramp : intervals;
+        const int32_t tailStart = intervals - ramp > headEnd ? intervals - ramp : headEnd;
+        auto total = static_cast<uint32_t>(intervals) * cruiseMs;
+        for (int32_t edge = 1; edge <= headEnd; edge++) {
+            total += static_cast<uint32_t>(rateAt(edge) - cruiseMs);
+        }
+        for (int32_t edge = tailStart + 1; edge <= intervals; edge++) {
+            total += static_cast<uint32_t>(rateAt(edge) - cruiseMs);
+        }
+        return total;
+    }
+};
+
+struct CycleTally {
+    uint32_t cycles = 0; // asked for
+    uint32_t done = 0; // finished, both moves
+    uint32_t endErrors = 0; // moves that didn't stop exactly on the target
+    uint32_t dutErrors = 0; // ends where the DUT didn't agree with us
+    int32_t dutDifference = 0; // DUT minus us at the last end read
+    uint32_t expectedMs = 0;
+    uint16_t jitterMs = 2;
+    uint32_t jittered = 0; // moves more than jitterMs off the one before
+    uint32_t maxLateMs = 0; // most a move took over expectedMs
+    uint32_t moves = 0;
+    uint32_t minMs = UINT32_MAX;
+    uint32_t maxMs = 0;
+    uint64_t totalMs = 0;
+    // Biggest change in duration from one cycle to the next, same direction
+    uint32_t maxStepMs = 0;
+    uint32_t lastMs[2] = {0, 0};
+
+    auto start(uint32_t count, uint32_t expected, uint16_t jitter) -> void {
+        *this = CycleTally{};
+        cycles = count;
+        expectedMs = expected;
+        jitterMs = jitter;
+    }
+
+    auto remaining() const -> uint32_t {
+        return cycles - done;
+    }
+
+    // A move took "ms" from its first edge to its last, true if that's
+    // jitter, "step" is how far it was off the last one that way
+    // The first move each way has nothing to compare with
+    auto addMove(bool forwards, uint32_t ms, uint32_t& step) -> bool {
+        uint32_t& last = lastMs[forwards ? 0 : 1];
+        step = 0;
+        if (last != 0) {
+            step = ms > last ? ms - last : last - ms;
+            maxStepMs = step > maxStepMs ? step : maxStepMs;
+        }
+        const bool jitter = last != 0 && step > jitterMs;
+        last = ms;
+        moves++;
+        totalMs += ms;
+        minMs = ms < minMs ? ms : minMs;
+        maxMs = ms > maxMs ? ms : maxMs;
+        if (ms > expectedMs && ms - expectedMs > maxLateMs) {
+            maxLateMs = ms - expectedMs;
+        }
+        if (jitter) {
+            jittered++;
+        }
+        return jitter;
+    }
+
+    auto meanMs() const -> uint32_t {
+        return moves == 0 ? 0 : static_cast<uint32_t>(totalMs / moves);
+    }
+
+    // Appends the run to an open file:
+    //   "P <ms> <distance> <start ms> <cruise ms> <ramp edges> <dwell ms> <cycles>"
+    //   "Q <done> <end errors> <DUT errors> <DUT difference> <expected ms>
+    //      <min ms> <mean ms> <max ms> <max cycle to cycle ms> <jittered moves>
+    //      <max late ms>"
+    auto write(int handle, uint32_t startedMs, const MoveProfile& profile, uint32_t dwellMs) const -> void {
+        TextLine line;
+        line.put('P').putInt(startedMs).putInt(profile.distance).putInt(profile.startMs).putInt(profile.cruiseMs)
+            .putInt(profile.rampEdges).putInt(dwellMs).putInt(cycles).writeFile(handle);
+        line.put('Q').putInt(done).putInt(endErrors).putInt(dutErrors).putInt(dutDifference).putInt(expectedMs)
+            .putInt(moves == 0 ? 0 : minMs).putInt(meanMs()).putInt(maxMs).putInt(maxStepMs).putInt(jittered)
+            .putInt(maxLateMs).writeFile(handle);
+    }
+};
@@ -0,0 +1,237 @@
+// Many encoder channels stepped together, one bit per channel
+//
+// Stepping every channel through nextStateTable one at a time costs
+// more and more per tick as channels are added. Here the state of all
+// channels is kept "bit sliced": bit n of every word belongs to channel n,
+// so one word operation works on all 32 channels at once.
+//
+//  - A and B levels are two masks. Moving one step along the quadrature
+//    sequence 00 -> 10 -> 11 -> 01 flips A when A == B and B otherwise
+//    (the other way round going backwards), which is a few ANDs and XORs.
+//  - Every channel counts down the ticks left until its next edge. The
+//    counters are bit sliced too (word k holds bit k of every counter),
+//    so decrementing all of them is a borrow going through the words.
+//    Channels whose counter borrows out of the top word are due, and
+//    having borrowed they are all ones, so reloading only clears bits.
+//  - Steps go into a small bit sliced signed accumulator, again a carry
+//    through a few words, that is folded into plain int32_t positions
+//    before it can overflow or when a position is read.
+// Nothing depends on how many channels there are: the borrow always goes
+// through the words the longest period needs, the accumulator is always
+// MULTICHANNEL_ACCUMULATOR_BITS words and the fold comes every so many
+// ticks. So a tick costs the same for 1 channel or 32, which for four
+// channels or fewer is more than the scalar loop below costs.
+//
+// tick() returns every pin in one mask: channel n's A is bit 2n and its B
+// bit 2n+1, ready for a back end that writes many pins at once.
+//
+// ScalarMultiChannel has the same interface and does the plain per-channel
+// loop. It is kept as the reference the bit sliced version is checked
+// against, and as the fallback (define QUAD_MULTICHANNEL_SCALAR), which
+// is the one to use for only a few channels.
+//
+// wasm simd128 would give 128 channels per operation, but the build does
+// not enable it and the Free-Wili has nowhere near 32 channels worth of
+// outputs, so plain 32 bit words are used.
+
+#pragma once
+
+#include <cstdint>
+
+const auto MULTICHANNEL_MAX = 32;
+// Longest time between edges, in ticks, is 2^MULTICHANNEL_COUNTER_BITS
+const auto MULTICHANNEL_COUNTER_BITS = 16;
+// Steps kept bit sliced before they go into the positions, signed
+const auto MULTICHANNEL_ACCUMULATOR_BITS = 8;
+// A channel moves at most one step per tick, so the accumulator can't
+// overflow in this many ticks
+const auto MULTICHANNEL_FOLD_TICKS = (1 << (MULTICHANNEL_ACCUMULATOR_BITS - 1)) - 1;
+
+// Spreads the 32 bits of x out to the even bits of a 64 bit word
+constexpr auto spreadBits(uint32_t x) -> uint64_t {
+    uint64_t v = x;
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+struct BitSlicedMultiChannel {
+    uint32_t pinA = 0;
+    uint32_t pinB = 0;
+    uint32_t forward = 0; // 1 = forwards
+    uint32_t enabled = 0;
+    uint32_t due = 0; // channels that moved on the last tick
+
+    // Bit sliced counters, word k holds bit k of every channel's counter
+    uint32_t countdown[MULTICHANNEL_COUNTER_BITS] = {};
+    uint32_t reload[MULTICHANNEL_COUNTER_BITS] = {};
+    // Words of the counters any channel uses, the rest are all zero
+    int counterWords = 1;
+
+    // Steps since the last fold, bit sliced two's complement
+    uint32_t steps[MULTICHANNEL_ACCUMULATOR_BITS] = {};
+    int ticksToFold = MULTICHANNEL_FOLD_TICKS;
+    int32_t positions[MULTICHANNEL_MAX] = {};
+
+    // Sets a channel up to move one step every periodTicks ticks
+    // (1 to 2^MULTICHANNEL_COUNTER_BITS)
+    auto configure(int channel, uint32_t periodTicks, bool forwards, bool enable) -> void {
+        const uint32_t bit = 1u << channel;
+        for (int k = 0; k < MULTICHANNEL_COUNTER_BITS; k++) {
+            const bool set = ((periodTicks - 1) >> k) & 1u;
+            reload[k] = set ? reload[k] | bit : reload[k] & ~bit;
+            countdown[k] = set ? countdown[k] | bit : countdown[k] & ~bit;
+        }
+        counterWords = 1;
+        for (int k = 1; k < MULTICHANNEL_COUNTER_BITS; k++) {
+            counterWords = reload[k] != 0 ? k + 1 : counterWords;
+        }
+        setDirection(channel, forwards);
+        enabled = enable ? enabled | bit : enabled & ~bit;
+    }
+
+    auto setDirection(int channel, bool forwards) -> void {
+        const uint32_t bit = 1u << channel;
+        forward = forwards ? forward | bit : forward & ~bit;
+    }
+
+    // Advances every channel by one tick, returns all the pin levels
+    auto tick() -> uint64_t {
+        // Count every enabled channel down, the ones that borrow out
+        // of the top were at zero and are due now
+        uint32_t borrow = enabled;
+        for (int k = 0; k < counterWords; k++) {
+            const uint32_t next = ~countdown[k] & borrow;
+            countdown[k] ^= borrow;
+            borrow = next;
+        }
+        due = borrow;
+        // No branches on what is due, on few channels they'd be guesses
+        // Back from all ones to the period, where its bit is clear
+        for (int k = 0; k < counterWords; k++) {
+            countdown[k] &= ~(due & ~reload[k]);
+        }
+        // Quadrature step for everything that is due
+        const uint32_t same = ~(pinA ^ pinB);
+        const uint32_t flipA = due & ~(same ^ forward);
+        pinA ^= flipA;
+        pinB ^= due & ~flipA;
+        count(due & forward, due & ~forward);
+        if (--ticksToFold == 0) {
+            fold();
+        }
+        return pinMask();
+    }
+
+    auto pinMask() const -> uint64_t {
+        return spreadBits(pinA) | (spreadBits(pinB) << 1);
+    }
+
+    auto position(int channel) -> int32_t {
+        fold();
+        return positions[channel];
+    }
+
+    // Adds one to the "up" channels' steps and takes one off the "down"
+    // ones. Either way a bit flips and the next one flips too if this one
+    // carried (was 1 going up) or borrowed (was 0 going down).
+    auto count(uint32_t up, uint32_t down) -> void {
+        uint32_t flip = up | down;
+        for (uint32_t& word : steps) {
+            const uint32_t was = word;
+            word ^= flip;
+            flip &= was ^ down;
+        }
+    }
+
+    // Moves the accumulated steps into the positions
+    auto fold() -> void {
+        ticksToFold = MULTICHANNEL_FOLD_TICKS;
+        uint32_t moved = 0;
+        for (const uint32_t word : steps) {
+            moved |= word;
+        }
+        while (moved != 0) {
+            const int channel = __builtin_ctz(moved);
+            moved &= moved - 1;
+            int32_t value = 0;
+            for (int k = 0; k < MULTICHANNEL_ACCUMULATOR_BITS; k++) {
+                value |= static_cast<int32_t>((steps[k] >> channel) & 1u) << k;
+            }
+            // Sign extend from the top accumulator bit
+            const int32_t negative = value >> (MULTICHANNEL_ACCUMULATOR_BITS - 1);
+            positions[channel] += value - (negative << MULTICHANNEL_ACCUMULATOR_BITS);
+        }
+        for (uint32_t& word : steps) {
+            word = 0;
+        }
+    }
+};
+
+// Same thing, one channel at a time
+struct ScalarMultiChannel {
+    // Same table as the single channel engine in quadrature.cpp
+    static constexpr int STATES[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+    uint8_t phase[MULTICHANNEL_MAX] = {};
+    bool forward[MULTICHANNEL_MAX] = {};
+    bool enabled[MULTICHANNEL_MAX] = {};
+    uint32_t countdown[MULTICHANNEL_MAX] = {};
+    uint32_t period[MULTICHANNEL_MAX] = {};
+    int32_t positions[MULTICHANNEL_MAX] = {};
+    uint32_t due = 0;
+    int channels = 0; // highest configured channel + 1
+
+    auto configure(int channel, uint32_t periodTicks, bool forwards, bool enable) -> void {
+        channels = channel >= channels ? channel + 1 : channels;
+        period[channel] = periodTicks;
+        countdown[channel] = periodTicks;
+        forward[channel] = forwards;
+        enabled[channel] = enable;
+    }
+
+    auto setDirection(int channel, bool forwards) -> void {
+        forward[channel] = forwards;
+    }
+
+    auto tick() -> uint64_t {
+        due = 0;
+        for (int channel = 0; channel < channels; channel++) {
+            if (!enabled[channel] || --countdown[channel] != 0) {
+                continue;
+            }
+            countdown[channel] = period[channel];
+            due |= 1u << channel;
+            if (forward[channel]) {
+                phase[channel] = static_cast<uint8_t>((phase[channel] + 1) & 3);
+                positions[channel]++;
+            } else {
+                phase[channel] = static_cast<uint8_t>((phase[channel] + 3) & 3);
+                positions[channel]--;
+            }
+        }
+        return pinMask();
+    }
+
+    auto pinMask() const -> uint64_t {
+        uint64_t mask = 0;
+        for (int channel = 0; channel < channels; channel++) {
+            mask |= static_cast<uint64_t>(STATES[phase[channel]][0]) << (2 * channel);
+            mask |= static_cast<uint64_t>(STATES[phase[channel]][1]) << (2 * channel + 1);
+        }
+        return mask;
+    }
+
+    auto position(int channel) const -> int32_t {
+        return positions[channel];
+    }
+};
+
+#ifdef QUAD_MULTICHANNEL_SCALAR
+using MultiChannelEngine = ScalarMultiChannel;
+#else
+using MultiChannelEngine = BitSlicedMultiChannel;
+#endif
@@ -3,6 +3,23 @@
 // number of teeth and 1/4 period delay. 
 
 #include "fwwasm.h"
+#include "arena.h"
+#include "characterize.h"
+#include "dut_readback.h"
+#include "encoder_engine.h"
+#include "glitch.h"
+#include "linear_scale.h"
+#include "move_cycle.h"
+#include "random_walk.h"
+#include "recorder.h"
+#include "schedule.h"
+#include "segment_plan.h"
+#include "sequence.h"
+#include "sincos_dac.h"
+#include "timesync.h"
+#include "trend.h"
+#include "uart_link.h"
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <ranges>
@@ -34,42 +51,90 @@ enum guiIndexes {panelIndex,
                 directionTextIndex,
                 directionNumberIndex,
                 quadModeTextIndex,
-                quadModeStateTextIndex};
+                quadModeStateTextIndex,
+                dutDiffTextIndex,
+                dutDiffNumberIndex,
+                dutDivergedTextIndex,
+                dutDivergedNumberIndex,
+                trendPlotIndex,
+                scaleTextIndex,
+                scaleNumberIndex};
+
+// Second panel, shows the results of the self benchmark
+// Every row is one engine configuration, the columns are
+// edges/s computed without touching the pins, with pin writes,
+// and through the real loop (waitms + GUI updates)
+const int benchPanelIndex = 1;
+enum benchGuiIndexes {benchTitleTextIndex,
+                      benchComputeTextIndex,
+                      benchPinsTextIndex,
+                      benchLoopTextIndex,
+                      benchRowTextIndex, // one per row
+                      benchNumberIndex = benchRowTextIndex + 8, // three per row
+                      benchMemTextIndex = benchNumberIndex + 24,
+                      benchMemNumberIndex}; // arena used, arena size, static data
+
+// Third panel, shows the count error vs frequency characterization
+const int charPanelIndex = 2;
+enum charGuiIndexes {charTitleTextIndex,
+                     charLogIndex,
+                     charMaxTextIndex,
+                     charMaxNumberIndex,
+                     charPlotIndex};
+// Log list and plot data channel the characterization uses
+const int CHAR_LOG = 1;
+const int CHAR_PLOT_DATA = 2;
+
+// Fourth panel, shows the glitch filter threshold search
+const int glitchPanelIndex = 3;
+enum glitchGuiIndexes {glitchLogIndex,
+                       glitchWidthTextIndex,
+                       glitchWidthNumberIndex,
+                       glitchFilterTextIndex,
+                       glitchFilterNumberIndex,
+                       glitchPassTextIndex,
+                       glitchPassNumberIndex,
+                       glitchNsTextIndex,
+                       glitchNsNumberIndex};
+// Log list the glitch search uses
+const int GLITCH_LOG = 2;
+
+// Fifth panel, shows the point to point move cycles
+const int cyclePanelIndex = 4;
+enum cycleGuiIndexes {cycleLogIndex,
+                      cycleDoneTextIndex,
+                      cycleDoneNumberIndex,
+                      cycleLeftTextIndex,
+                      cycleLeftNumberIndex,
+                      cycleErrorsTextIndex,
+                      cycleErrorsNumberIndex,
+                      cycleJitterTextIndex,
+                      cycleJitterNumberIndex,
+                      cycleMoveTextIndex,
+                      cycleMoveNumberIndex};
+// Log list the move cycles flag errors and jitter on
+const int CYCLE_LOG = 3;
 
 // Pins to output the quadrature signal
 // These correspond to GPIO pins in programming
 // 13 -> 1 and 27 -> 3 in the pin numbers on the outside 
 #define PinA 13 
 #define PinB 27
+// Index pin, pulsed for one edge on request (5 on the outside)
+#define PinIndex 26
 #define MaxValueControl INT_MAX
 #define MinValueControl INT_MIN
 
-// Next state transition table of a quadrature encoder
-// Representas all the LEGAL states of a qudrature encoder
-// Encoded as a two dimensional table
-// The first index is in incremented if the encoder
-// is moving forward, otherwise it's decremented
-// pinA is the first index, pinB is the second
-const int nextStateTable[][4] = {{0,0},{1,0},{1,1},{0,1}};
-int nextStateIndex = 0; //Initial state of the sensor
-int direction = 1; // Direction of the encoder, 1 for increasing, 0 for decreasing
-
-// How long before the quadrature encoder "pins"
-// change state
-// the sensor refresh rate will be the DRIVING variable, as it needs to be a positive WHOLE number
-// in order for this to work...
-unsigned int sensorRefreshRate = 10; // in milliseconds
-// sensor refresh rate is essentially the 1/4 the period of freuency of pinA or pinB
-unsigned long sensorOldMillis = 0; // temp variable used to store the millis time since the last refreshV
+// The encoder: pin states, counters and edge timing, see encoder_engine.h
+QuadratureEngine engine;
 
 // "Sensor" simulated variables, like teeth# (simulating a gear-based qudrature encoder)
 // and other parameters
 unsigned int numberTeeth = 25; // Simulates the teeth # in the sensor "gear"
-float revPerSecond = (1/(  static_cast<float>(sensorRefreshRate*4*numberTeeth)) )*1000; // Records the speed of the shaft
+float revPerSecond = (1/(  static_cast<float>(engine.sensorRefreshRate*4*numberTeeth)) )*1000; // Records the speed of the shaft
 // We need to calculate the revolution per second
 // based on the sensor refresh rate (time that EITHER pinA or pinB changes)
 // This will be equal to: refreshrate/4 
-int totalRefs = 0; // Stores the total number of revs the sensor has "traveled"
 
 // Stores the mode that the virtual quadrature encoder is in
 // 0 is free-running (just runs)
@@ -77,6 +142,180 @@ int totalRefs = 0; // Stores the total number of revs the sensor has "traveled"
 uint8_t quadMode = 0;
 int tickLimit = 1;
 
+// Every large buffer lives in this arena, see arena.h
+// Any new component that needs one adds its budget to this list
+constexpr size_t APP_ARENA_BYTES = arenaTotal<TIME_SYNC_ARENA_BYTES,
+                                              COMMAND_SCHEDULE_ARENA_BYTES,
+                                              SEQUENCER_ARENA_BYTES,
+                                              FLIGHT_RECORDER_ARENA_BYTES,
+                                              CHARACTERIZATION_ARENA_BYTES,
+                                              SEGMENT_PLAN_ARENA_BYTES,
+                                              DUT_LOG_ARENA_BYTES>();
+static_assert(APP_ARENA_BYTES <= ARENA_CAPACITY, "The arena does not fit next to the stack, see arena.h");
+StaticArena<APP_ARENA_BYTES> appArena;
+
+// Link to the test PC over the UART
+// The PC answers our pings so we can stamp telemetry in its clock
+UartLineReader uartReader;
+TimeSync& timeSync = appArena.make<TimeSync>();
+// How often a telemetry frame is sent to the PC
+unsigned int telemetryPeriodMs = 100;
+unsigned int telemetryOldMillis = 0;
+// How often the loop updates the main panel, 1 is every loop
+// Both can be changed with a "U" line, host/config_explorer finds the
+// fastest rates each setting leaves room for
+unsigned int guiPeriodMs = 1;
+unsigned int guiOldMillis = 0;
+
+// Set while the index pin is up
+bool indexPulseActive = false;
+
+// Cleared by the self benchmark to time the engine without setIO calls
+bool pinOutputEnabled = true;
+
+// Commands the PC queued up to run at a set time or position
+CommandSchedule& schedule = appArena.make<CommandSchedule>();
+
+// Runs the coroutine sequences (LED animations, test routines...)
+// alongside the encoder, see sequence.h
+Sequencer& sequencer = appArena.make<Sequencer>();
+
+// Last few hundred edges and events, dumped when something goes wrong
+// See recorder.h for the format
+FlightRecorder& recorder = appArena.make<FlightRecorder>();
+// An edge this late (or later) means the encoder skipped a beat,
+// at least one whole 1/4 period and never less than 2ms, since the
+// loop itself takes a millisecond
+const unsigned int MISSED_DEADLINE_MIN_MS = 2;
+// Where dumps triggered on the device end up
+const char* const TRACE_FILE = "quadtrace.txt";
+// Dump in progress, one recorder block is written per loop
+enum class DumpTarget : uint8_t {none, file, uart};
+DumpTarget dumpTarget = DumpTarget::none;
+int dumpBlock = 0;
+int dumpHandle = -1;
+// Dumps the encoder triggers itself (a missed deadline, a DUT mismatch)
+// come at most this often, so a rate the loop keeps missing by a little
+// doesn't keep writing the flash. Asked for dumps always go.
+const unsigned int AUTO_DUMP_HOLDOFF_MS = 30000;
+unsigned int autoDumpMs = 0;
+bool autoDumped = false;
+
+// Reads the device under test's counter and compares it with ours
+// Set up from the PC with a "D" line, see handle_dut_line
+DutReadback dut;
+// Only read the DUT when the next edge is at least this far away
+const int DUT_READ_SLACK_MS = 2;
+// Every change in the difference is appended here:
+// "D <ms> <our ticks> <DUT count> <difference>"
+const char* const DUT_LOG_FILE = "quaddut.txt";
+// The changes are kept in dutLog and written out at most this long after
+DutLog& dutLog = appArena.make<DutLog>();
+const unsigned int DUT_LOG_FLUSH_MS = 5000;
+
+// Velocity and position trend plot, see trend.h
+TrendDecimator trend;
+const uint32_t TREND_POINTS_PER_SECOND = 10;
+// Plot data channels, both on the trend plot
+const int TREND_VELOCITY_DATA = 3;
+const int TREND_POSITION_DATA = 4;
+// The plot goes from -TREND_RANGE to TREND_RANGE: edges/s for the velocity
+// (the engine tops out at 1000) and ticks from trendOrigin for the
+// position. The origin moves to the position when it runs off the plot.
+const int TREND_RANGE = 1000;
+int32_t trendOrigin = 0;
+
+// Analog sin/cos outputs, off until set up with an "A" line
+SinCosDac dac;
+
+// Linear scale mode, off (rotary) until set up with an "L" line
+LinearScale scale;
+
+// Count error vs frequency characterization, see characterize_dut()
+CharacterizationTable& charTable = appArena.make<CharacterizationTable>();
+// 1/4 periods to try, slowest first
+constexpr std::array<uint16_t, 7> CHAR_RATES_MS{20, 10, 5, 4, 3, 2, 1};
+// Ticks moved forwards (and back) at every rate
+const int CHAR_COUNTS = 400;
+// Results are appended here, see CharacterizationTable::write
+const char* const CHAR_FILE = "quadchar.txt";
+bool characterizing = false;
+
+// Glitch filter threshold search, see glitch_search()
+// How long the time one pin write takes is measured for
+const unsigned int GLITCH_CALIBRATE_MS = 50;
+// Every search appends one line here:
+// "G <ms> <ns per write> <filter threshold> <pass threshold>"
+// thresholds in pin writes, GLITCH_MAX_WRITES + 1 if never counted
+const char* const GLITCH_FILE = "quadglitch.txt";
+bool glitchSearching = false;
+
+// Home cycle, see home_axis(), set up with an "H" line
+// Where the axis' reference mark is, the index pulses when it's crossed
+int32_t homeIndexAt = 200;
+// 1/4 period while searching for the index
+unsigned int homeSearchMs = 2;
+// 1/4 period of the second, slow approach, 0 = no second approach
+unsigned int homeSlowMs = 10;
+// Ticks past the index (in the direction of travel) to stop and zero at
+int32_t homeOffset = 0;
+// How far the search overshoots before backing off for the slow approach
+int32_t homeBackoff = 20;
+bool homing = false;
+
+// Random walk soak mode, see random_walk(), started with a "W" line
+RandomWalk walk;
+bool walking = false;
+// Every start and stop gets a new number, so a walk that is still
+// waiting when it's stopped and started again knows to finish
+uint32_t walkRun = 0;
+
+// Point to point move cycles, see move_cycles(), set up and started with
+// a "P" line
+MoveProfile cycleProfile;
+CycleTally cycleTally;
+unsigned int cycleDwellMs = 500;
+bool cycling = false;
+// Same as walkRun, a new number for every start and stop
+uint32_t cycleRun = 0;
+// Kept for finish_cycles(), the run may be stopped from outside
+unsigned int cycleStartedMs = 0;
+unsigned int cycleSavedRate = 1;
+unsigned int cycleRunDwellMs = 0;
+// Longest move, 1000s at 1ms so the expected move time fits 32 bits
+const int32_t CYCLE_MAX_DISTANCE = 1000000;
+// Every run appends its tally here, see CycleTally::write
+const char* const CYCLE_FILE = "quadcycle.txt";
+
+// Segment plans, see play_plan(), loaded and played with "S" lines
+SegmentPlan& plan = appArena.make<SegmentPlan>();
+SegmentPlayer planPlayer;
+PlanTally planTally;
+bool playing = false;
+// Same as walkRun, a new number for every start and stop
+uint32_t planRun = 0;
+// Kept for finish_plan(), the plan may be stopped from outside
+unsigned int planStartedMs = 0;
+unsigned int planSavedRate = 1;
+// "S L" loads the plan from here, the same "S+" lines the UART takes
+const char* const PLAN_FILE = "quadplan.txt";
+// Every run appends its tally here, see PlanTally::write
+const char* const PLAN_RUN_FILE = "quadplanrun.txt";
+
+// Counts the times the encoder was stopped by hand, see stop_by_hand()
+// A run that moves the encoder keeps the count it started with and gives
+// up once it changes
+uint32_t handStops = 0;
+
+// A run is moving the encoder: nothing else starts one, and the buttons
+// and the schedule keep their hands off it (Blue only stops it)
+auto encoder_busy() -> bool {
+    return characterizing || glitchSearching || homing || walking || cycling || playing;
+}
+
+// Which panel is on screen, the buttons mean different things on each
+int shownPanel = panelIndex;
+
 // Struct to store colors as individual channels
 struct Color {
     uint8_t red;
@@ -124,13 +363,149 @@ auto setupMainPanelMenu(){
     //setCanDisplayReactToButtons(0);
     
     // Don't log anything, we don't need it
-    setPanelMenuText(panelIndex,0,"DNU!");
-    setPanelMenuText(panelIndex,1,"DNU!");
+    setPanelMenuText(panelIndex,0,"Bench");
+    setPanelMenuText(panelIndex,1,"Dump");
     setPanelMenuText(panelIndex,2,"TDir");
     setPanelMenuText(panelIndex,3,"Toggle");
     setPanelMenuText(panelIndex,4,"Exit");
 }
 
+// Engine configurations timed by the self benchmark
+// New modes should add a row here (8 rows max)
+struct BenchmarkCase {
+    const char* name;
+    int direction;
+    bool linearScale; // reference marks and their index pulses on every edge
+};
+constexpr std::array benchmarkCases{
+    BenchmarkCase{"FRun+", 1, false},
+    BenchmarkCase{"FRun-", 0, false},
+    BenchmarkCase{"Scale", 1, true},
+};
+
+// Helper function to setup the self benchmark panel
+// Hidden until the benchmark is run
+auto setup_bench_panel() -> void {
+    addPanel(benchPanelIndex, 0, 0, 0, 0, 0, 0, 0, 1);
+    setPanelMenuText(benchPanelIndex,0,"Back");
+    setPanelMenuText(benchPanelIndex,1,"Char");
+    setPanelMenuText(benchPanelIndex,2,"Glitch");
+    setPanelMenuText(benchPanelIndex,3,"Home");
+    setPanelMenuText(benchPanelIndex,4,"Back");
+
+    addControlText(benchPanelIndex,benchTitleTextIndex,
+                   3, 3, 1, 64,
+                   WHITE.red, WHITE.green, WHITE.blue, "Edges/s");
+    addControlText(benchPanelIndex,benchComputeTextIndex,
+                   80, 23, 1, 64,
+                   WHITE.red, WHITE.green, WHITE.blue, "Calc");
+    addControlText(benchPanelIndex,benchPinsTextIndex,
+                   160, 23, 1, 64,
+                   WHITE.red, WHITE.green, WHITE.blue, "Pins");
+    addControlText(benchPanelIndex,benchLoopTextIndex,
+                   240, 23, 1, 64,
+                   WHITE.red, WHITE.green, WHITE.blue, "Loop");
+    for(int row=0;row<static_cast<int>(benchmarkCases.size());row++){
+        const int y = 43 + row*20;
+        addControlText(benchPanelIndex,benchRowTextIndex+row,
+                       3, y, 1, 64,
+                       WHITE.red, WHITE.green, WHITE.blue, benchmarkCases[static_cast<size_t>(row)].name);
+        for(int column=0;column<3;column++){
+            addControlNumber(benchPanelIndex,benchNumberIndex+row*3+column,1,
+                             80+column*80,y,10,1,1,
+                             0,255,0,0,0,0,0);
+        }
+    }
+
+    // Memory report, never changes after startup so it is set once here
+    addControlText(benchPanelIndex,benchMemTextIndex,
+                   3, 210, 1, 64,
+                   WHITE.red, WHITE.green, WHITE.blue, "Mem");
+    const int memory[3] = {static_cast<int>(appArena.usedBytes()),
+                           static_cast<int>(appArena.capacity()),
+                           static_cast<int>(staticBytesUsed())};
+    for(int column=0;column<3;column++){
+        addControlNumber(benchPanelIndex,benchMemNumberIndex+column,1,
+                         80+column*80,210,10,1,1,
+                         0,255,0,0,0,0,0);
+        setControlValue(benchPanelIndex,benchMemNumberIndex+column,memory[column]);
+    }
+}
+
+// Helper function to setup the characterization panel
+// Hidden until a characterization is started
+auto setup_char_panel() -> void {
+    addPanel(charPanelIndex, 0, 0, 0, 0, 0, 0, 0, 1);
+    for(int button=0;button<5;button++){
+        setPanelMenuText(charPanelIndex,button,"Back");
+    }
+    addControlText(charPanelIndex,charTitleTextIndex,
+                   3, 3, 1, 64,
+                   WHITE.red, WHITE.green, WHITE.blue, "ms e/s fwd net");
+    // One line per rate, filled in as the run goes
+    addControlLogList(charPanelIndex,charLogIndex,1,CHAR_LOG,
+                      3,23,200,160,1,1,
+                      0,0,0,
+                      WHITE.red, WHITE.green, WHITE.blue,0);
+    // Error at the far end for every rate, left to right
+    addControlPlot(charPanelIndex,charPlotIndex,1,
+                   1<<CHAR_PLOT_DATA,210,23,100,100,
+                   -10,10,10,120,30);
+    addControlPlotData(CHAR_PLOT_DATA,255,255,0);
+    addControlText(charPanelIndex,charMaxTextIndex,
+                   3, 200, 1, 64,
+                   WHITE.red, WHITE.green, WHITE.blue, "Max ok e/s:");
+    addControlNumber(charPanelIndex,charMaxNumberIndex,1,
+                     125,198,10,1,1,
+                     0,255,0,0,0,0,0);
+}
+
+// Helper function to setup the glitch search panel
+// Hidden until a search is started
+auto setup_glitch_panel() -> void {
+    addPanel(glitchPanelIndex, 0, 0, 0, 0, 0, 0, 0, 1);
+    for(int button=0;button<5;button++){
+        setPanelMenuText(glitchPanelIndex,button,"Back");
+    }
+    // One line per probe: kind, width, counted
+    addControlLogList(glitchPanelIndex,glitchLogIndex,1,GLITCH_LOG,
+                      3,3,150,200,1,1,
+                      0,0,0,
+                      WHITE.red, WHITE.green, WHITE.blue,0);
+    const char* const labels[4] = {"Width:", "Filter:", "Pass:", "ns/wr:"};
+    for(int row=0;row<4;row++){
+        addControlText(glitchPanelIndex,glitchWidthTextIndex+row*2,
+                       160, 23+row*40, 1, 64,
+                       WHITE.red, WHITE.green, WHITE.blue, labels[row]);
+        addControlNumber(glitchPanelIndex,glitchWidthNumberIndex+row*2,1,
+                         240,21+row*40,10,1,1,
+                         0,255,0,0,0,0,0);
+    }
+}
+
+// Helper function to setup the move cycle panel
+// Hidden until move cycles are started
+auto setup_cycle_panel() -> void {
+    addPanel(cyclePanelIndex, 0, 0, 0, 0, 0, 0, 0, 1);
+    for(int button=0;button<5;button++){
+        setPanelMenuText(cyclePanelIndex,button,"Back");
+    }
+    // One line per end error or jittered move: kind, cycle, value
+    addControlLogList(cyclePanelIndex,cycleLogIndex,1,CYCLE_LOG,
+                      3,3,150,200,1,1,
+                      0,0,0,
+                      WHITE.red, WHITE.green, WHITE.blue,0);
+    const char* const labels[5] = {"Cycle:", "Left:", "Errors:", "Jitter:", "Move ms:"};
+    for(int row=0;row<5;row++){
+        addControlText(cyclePanelIndex,cycleDoneTextIndex+row*2,
+                       160, 23+row*35, 1, 64,
+                       WHITE.red, WHITE.green, WHITE.blue, labels[row]);
+        addControlNumber(cyclePanelIndex,cycleDoneNumberIndex+row*2,1,
+                         240,21+row*35,10,1,1,
+                         0,255,0,0,0,0,0);
+    }
+}
+
 // Helper function to setup panels 
 auto setup_panels() -> void {
     // Setup the main panel
@@ -170,17 +545,17 @@ auto setup_panels() -> void {
     addControlNumber(panelIndex,refreshNumberIndex,1,
                     215,43,10,1,1,
                     0,255,0,0,0,0,0);
-    setControlValue(panelIndex,refreshNumberIndex,static_cast<int>(sensorRefreshRate));
+    setControlValue(panelIndex,refreshNumberIndex,static_cast<int>(engine.sensorRefreshRate));
     // Shows the total number of revolutions
     addControlNumber(panelIndex,totalRefsNumberIndex,1,
                     125,148,10,1,1,
                     0,255,0,0,0,0,0);
-    setControlValue(panelIndex,totalRefsNumberIndex,totalRefs);
+    setControlValue(panelIndex,totalRefsNumberIndex,engine.totalRefs);
     // Shows the direction (1 is forward, 0 is backwards )
     addControlNumber(panelIndex,directionNumberIndex,1,
                     115,168,10,1,1,
                     0,255,0,0,0,0,0);
-    setControlValue(panelIndex,directionNumberIndex,direction);
+    setControlValue(panelIndex,directionNumberIndex,engine.direction);
 
     // TEXT~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     // This adds text next to the increment number, all calls to "addControlText" do the same thing
@@ -217,6 +592,30 @@ auto setup_panels() -> void {
     addControlText(panelIndex,quadModeStateTextIndex, 
                    166, 66, 1, 64, 
                    GREEN.red, GREEN.green, GREEN.blue, "FRun");
+    // Difference between the device under test's count and ours,
+    // and when they first disagreed (0 until they do)
+    addControlText(panelIndex,dutDiffTextIndex, 
+                   3, 190, 1, 64, 
+                   WHITE.red, WHITE.green, WHITE.blue, "DUT diff:");
+    addControlNumber(panelIndex,dutDiffNumberIndex,1,
+                    115,188,10,1,1,
+                    0,255,0,0,0,0,0);
+    setControlValue(panelIndex,dutDiffNumberIndex,0);
+    addControlText(panelIndex,dutDivergedTextIndex, 
+                   3, 210, 1, 64, 
+                   WHITE.red, WHITE.green, WHITE.blue, "1st diff ms:");
+    addControlNumber(panelIndex,dutDivergedNumberIndex,1,
+                    125,208,10,1,1,
+                    0,255,0,0,0,0,0);
+    setControlValue(panelIndex,dutDivergedNumberIndex,0);
+    // Position on a linear scale, stays 0 in rotary mode
+    addControlText(panelIndex,scaleTextIndex, 
+                   205, 200, 1, 64, 
+                   WHITE.red, WHITE.green, WHITE.blue, "um:");
+    addControlNumber(panelIndex,scaleNumberIndex,1,
+                    240,198,10,1,1,
+                    0,255,0,0,0,0,0);
+    setControlValue(panelIndex,scaleNumberIndex,0);
     //TODO set min/max for number control values
 
     // EXPERIMENTAL 
@@ -241,6 +640,23 @@ auto setup_panels() -> void {
     clearLogOrPlotData(0,x);
     }
 
+    // Speed (blue) and position (yellow) over time, a few points a second
+    addControlPlot(panelIndex,trendPlotIndex,1,
+                   (1<<TREND_VELOCITY_DATA)|(1<<TREND_POSITION_DATA),205,95,110,90,
+                   -TREND_RANGE,TREND_RANGE,10,120,30);
+    addControlPlotData(TREND_VELOCITY_DATA,0,200,255);
+    addControlPlotData(TREND_POSITION_DATA,255,255,0);
+    trend.setPointsPerSecond(TREND_POINTS_PER_SECOND);
+
+
+    // Results of the self benchmark live on their own panel
+    setup_bench_panel();
+    // So do the results of the characterization
+    setup_char_panel();
+    // And the glitch filter threshold search
+    setup_glitch_panel();
+    // And the move cycles
+    setup_cycle_panel();
 
     //setCanDisplayReactToButtons(0);
     // Show the panel
@@ -248,8 +664,9 @@ auto setup_panels() -> void {
     
 }
 
-// Helper function to show of ranbow of LED's
-auto show_rainbow_leds(const int max_loops) -> void {
+// Sequence to show of ranbow of LED's
+// Runs next to the encoder instead of holding it up for the whole show
+auto show_rainbow_leds(Sequencer& seq, const int max_loops) -> Sequence {
     const std::array colors{RED, ORANGE, YELLOW, GREEN, LIGHT_GREEN, BLUE, LIGHT_BLUE, INDIGO, VIOLET, PINK};
     size_t color_choice = 0;
     // do the whole thing multiple times
@@ -268,17 +685,1368 @@ auto show_rainbow_leds(const int max_loops) -> void {
                 color_choice = 0;
             }
             // wait before setting the next LED
-            waitms(50);
+            co_await seq.after(50);
         }
     }
 }
 
+// All the encoder pin writes go through here
+auto write_pin(int io, int on) -> void {
+    if(pinOutputEnabled){
+        setIO(io,on);
+    }
+}
+
+// Raises the index pin, it is lowered again on the next edge
+auto pulseIndex() -> void {
+    indexPulseActive = true;
+    write_pin(PinIndex,1);
+}
+
 // Control the state of the simulate sensor outputs
 // Arguments are if the simulated qudrature should increase by one tick/state
 // or decrease by one tick/state
 // direction: 0 = backwards, 1 = forwards
 auto quadratureNextTick(int direction) -> void{
-    
+    // The index pin only stays up until the next edge
+    if(indexPulseActive){
+        indexPulseActive = false;
+        write_pin(PinIndex,0);
+    }
+    engine.step(direction);
+    write_pin(PinA,engine.sensorState[0]);
+    write_pin(PinB,engine.sensorState[1]);
+
+    // A linear scale has its reference marks instead of revolutions,
+    // the index goes up on a mark and totalRefs counts the marks passed
+    if(scale.enabled && scale.edge(engine.transitionCount)){
+        engine.totalRefs = scale.marksPassed;
+        pulseIndex();
+    }
+}
+
+// Changes the 1/4 period and the numbers that depend on it
+auto set_refresh_rate(unsigned int rateMs) -> void {
+    engine.sensorRefreshRate = rateMs;
+    revPerSecond = (1/(  static_cast<float>(engine.sensorRefreshRate*4*numberTeeth)) )*1000;
+    setControlValue(panelIndex,refreshNumberIndex,static_cast<int>(engine.sensorRefreshRate));
+    setControlValueFloat(panelIndex,revolutionNumIndex,revPerSecond);
+}
+
+// Starts making edges, the first one right away
+// The deadlines count from now, not from when we stopped
+auto start_simulation() -> void {
+    if (engine.stopSimulation) {
+        engine.stopSimulation = false;
+        engine.sensorOldMillis = millis();
+    }
+}
+
+// Holds the encoder pins where they are for "writes" pin writes
+// The fastest way there is to make a short, known delay
+auto hold_pins(int writes) -> void {
+    for(int i=0;i<writes;i++){
+        write_pin(PinA,engine.sensorState[0]);
+    }
+}
+
+// Makes "position" the current position without making any edges
+// Like a controller's preset: the pins stay as they are, the counters
+// (and whatever is waiting on them) carry on from the new position
+auto preset_position(int32_t position) -> void {
+    recorder.event(millis(), engine.transitionCount, RecordKind::preset, position);
+    engine.preset(position);
+    if(scale.enabled){
+        scale.locate(position);
+    }
+    schedule.setPosition(position);
+    trend.restart();
+    setControlValue(panelIndex,transitionNumIndex,engine.transitionCount);
+    setControlValue(panelIndex,totalRefsNumberIndex,engine.totalRefs);
+}
+
+// Carries out one command from the schedule
+// While a run moves the encoder only its own commands and index pulses
+// run, anything else queued from the PC is dropped
+auto run_command(const ScheduledCommand& command) -> void {
+    if (encoder_busy() && !command.byRun && command.action != ScheduleAction::pulseIndex) {
+        return;
+    }
+    recorder.event(millis(), engine.transitionCount, RecordKind::command, static_cast<int32_t>(command.action));
+    switch (command.action) {
+    case ScheduleAction::setRate:
+        if (command.value > 0) {
+            set_refresh_rate(static_cast<unsigned int>(command.value));
+        }
+        break;
+    case ScheduleAction::reverse:
+        engine.direction = !engine.direction;
+        setControlValue(panelIndex,directionNumberIndex,engine.direction);
+        break;
+    case ScheduleAction::stop:
+        engine.stopSimulation = true;
+        break;
+    case ScheduleAction::start:
+        start_simulation();
+        break;
+    case ScheduleAction::pulseIndex:
+        pulseIndex();
+        break;
+    case ScheduleAction::preset:
+        preset_position(command.value);
+        break;
+    }
+}
+
+// Runs the commands scheduled for the position we just arrived at
+// Only the head of the position queue is looked at. The direction is the
+// one the edge came from, taken before any of them runs, so a reverse
+// doesn't hide the commands after it at the same position.
+auto run_position_commands() -> void {
+    const bool forward = engine.direction != 0;
+    ScheduledCommand command;
+    while (schedule.popAtPosition(engine.transitionCount, forward, command)) {
+        run_command(command);
+    }
+}
+
+// Runs the commands scheduled at or before nowMs
+auto run_time_commands(unsigned int nowMs) -> void {
+    ScheduledCommand command;
+    while (schedule.popDueTime(nowMs, command)) {
+        run_command(command);
+    }
+}
+
+// Parses a schedule line from the PC and queues it:
+// "@T <ms> <action> [value]"  at millis() == ms, "+ms" is relative to now
+// "@P <ticks> <action> [value]"  when the tick count arrives at "ticks"
+// "@C"  clear both queues
+// Actions are R (rate, value in ms), V (reverse), S (stop), G (go), I (index),
+// P (preset, value is the new position)
+// Answers "K 1" if the command was queued, "K 0" if not, only index
+// pulses are taken while a run moves the encoder (see encoder_busy)
+auto handle_schedule_line(const char* line, unsigned int nowMs) -> bool {
+    if (line[0] != '@') {
+        return false;
+    }
+    TextLine reply;
+    reply.put('K');
+    if (line[1] == 'C') {
+        schedule.clear();
+        reply.putInt(1).sendUart();
+        return true;
+    }
+    const char queue = line[1];
+    const char* cursor = line + 2;
+    while (*cursor == ' ') {
+        cursor++;
+    }
+    const bool relative = *cursor == '+';
+    if (relative) {
+        cursor++;
+    }
+    int64_t at = 0;
+    bool ok = parseInt(cursor, at);
+    while (*cursor == ' ') {
+        cursor++;
+    }
+    ScheduleAction action = ScheduleAction::stop;
+    switch (*cursor) {
+    case 'R': action = ScheduleAction::setRate; break;
+    case 'V': action = ScheduleAction::reverse; break;
+    case 'S': action = ScheduleAction::stop; break;
+    case 'G': action = ScheduleAction::start; break;
+    case 'I': action = ScheduleAction::pulseIndex; break;
+    case 'P': action = ScheduleAction::preset; break;
+    default: ok = false; break;
+    }
+    if (*cursor != '\0') {
+        cursor++;
+    }
+    int64_t value = 0;
+    parseInt(cursor, value);
+    ok = ok && (action == ScheduleAction::pulseIndex || !encoder_busy());
+
+    if (ok && queue == 'T') {
+        const uint32_t atMs = static_cast<uint32_t>(relative ? nowMs + static_cast<uint32_t>(at) : at);
+        ok = schedule.addAtTime(atMs, action, static_cast<int32_t>(value), nowMs);
+    } else if (ok && queue == 'P') {
+        ok = schedule.addAtPosition(static_cast<int32_t>(at), action, static_cast<int32_t>(value), engine.transitionCount);
+    } else {
+        ok = false;
+    }
+    reply.putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// Freezes the recorder and starts dumping it
+// Does nothing if a dump is already going
+auto start_dump(FreezeReason reason, DumpTarget target) -> void {
+    if (dumpTarget != DumpTarget::none) {
+        return;
+    }
+    recorder.freeze(reason, millis());
+    if (target == DumpTarget::file) {
+        dumpHandle = openFile(TRACE_FILE, FILE_MODE_APPEND);
+        if (dumpHandle < 0) {
+            recorder.reset();
+            return;
+        }
+    }
+    dumpTarget = target;
+    dumpBlock = 0;
+    // "R <reason> <frozen at ms> <blocks>" starts every dump
+    TextLine header;
+    header.put('R').putInt(static_cast<int>(recorder.frozen)).putInt(recorder.frozenAtMs).putInt(recorder.blockCount());
+    if (dumpTarget == DumpTarget::file) {
+        header.writeFile(dumpHandle);
+    } else {
+        header.sendUart();
+    }
+}
+
+// Dump the encoder triggered itself, held off for AUTO_DUMP_HOLDOFF_MS
+// after the last one
+auto auto_dump(FreezeReason reason, unsigned int nowMs) -> void {
+    if (dumpTarget != DumpTarget::none || (autoDumped && nowMs - autoDumpMs < AUTO_DUMP_HOLDOFF_MS)) {
+        return;
+    }
+    autoDumped = true;
+    autoDumpMs = nowMs;
+    start_dump(reason, DumpTarget::file);
+}
+
+// Writes out the next recorder block, "Z" ends the dump
+// The recorder starts again once it has all been written
+auto dump_step() -> void {
+    if (dumpTarget == DumpTarget::none) {
+        return;
+    }
+    auto emit = [](TextLine& line) {
+        if (dumpTarget == DumpTarget::file) {
+            line.writeFile(dumpHandle);
+        } else {
+            line.sendUart();
+        }
+    };
+    if (dumpBlock < recorder.blockCount()) {
+        recorder.decodeBlock(dumpBlock++, emit);
+        return;
+    }
+    TextLine end;
+    end.put('Z');
+    emit(end);
+    if (dumpTarget == DumpTarget::file) {
+        closeFile(dumpHandle);
+        dumpHandle = -1;
+    }
+    dumpTarget = DumpTarget::none;
+    recorder.reset();
+}
+
+// Adds a point to the velocity and position trend plot
+auto plot_trend() -> void {
+    if (engine.transitionCount - trendOrigin > TREND_RANGE || trendOrigin - engine.transitionCount > TREND_RANGE) {
+        trendOrigin = engine.transitionCount;
+    }
+    const int32_t velocity = std::clamp(trend.velocity, -TREND_RANGE, TREND_RANGE);
+    setPlotData(TREND_VELOCITY_DATA,1,velocity);
+    setPlotData(TREND_POSITION_DATA,1,engine.transitionCount - trendOrigin);
+}
+
+// How far the engine is towards its next edge, 0 to 65535
+// Lets the analog outputs move smoothly between edges
+auto towards_next_edge(unsigned int nowMs) -> uint32_t {
+    if (engine.stopSimulation || engine.sensorRefreshRate == 0) {
+        return 0;
+    }
+    const auto remainingMs = static_cast<int>(engine.sensorOldMillis - nowMs);
+    if (remainingMs <= 0) {
+        return 65535;
+    }
+    if (remainingMs >= static_cast<int>(engine.sensorRefreshRate)) {
+        return 0;
+    }
+    return (engine.sensorRefreshRate - static_cast<unsigned int>(remainingMs)) * 65535 / engine.sensorRefreshRate;
+}
+
+// "A <periods per revolution> <update ms>" sets up the analog outputs,
+// 0 periods turns them off. Answers "K 1" or "K 0".
+auto handle_dac_line(const char* line) -> bool {
+    if (line[0] != 'A') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    int64_t periods = 0;
+    int64_t updateMs = 1;
+    const bool ok = parseInt(cursor, periods) && periods >= 0 && periods <= 65535
+                    && (!parseInt(cursor, updateMs) || (updateMs >= 1 && updateMs <= 1000));
+    if (ok) {
+        dac.configure(static_cast<uint32_t>(periods), 4*numberTeeth, static_cast<uint32_t>(updateMs));
+    }
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// "L <signal period nm> <mark spacing in periods>" makes this a linear
+// scale with distance coded reference marks (see linear_scale.h),
+// "L 0" goes back to rotary. Answers "K 1" or "K 0".
+auto handle_scale_line(const char* line) -> bool {
+    if (line[0] != 'L') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    int64_t periodNm = 0;
+    int64_t spacing = 1000;
+    bool ok = parseInt(cursor, periodNm) && periodNm >= 0 && periodNm <= 1000000
+              && (!parseInt(cursor, spacing) || (spacing >= 8 && spacing <= 1000000));
+    if (ok && periodNm == 0) {
+        // Revolutions carry on from where the scale is
+        scale.enabled = false;
+        engine.countRevolutions = true;
+        engine.preset(engine.transitionCount);
+        setControlValue(panelIndex,scaleNumberIndex,0);
+    } else if (ok) {
+        ok = scale.configure(static_cast<uint32_t>(periodNm), static_cast<int32_t>(spacing), engine.transitionCount);
+        engine.countRevolutions = !ok;
+        engine.totalRefs = ok ? 0 : engine.totalRefs;
+    }
+    setControlValue(panelIndex,totalRefsNumberIndex,engine.totalRefs);
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// "U <GUI ms> <telemetry ms>" sets how often the main panel is updated
+// and a telemetry frame is sent. Answers "K 1" or "K 0".
+auto handle_rates_line(const char* line) -> bool {
+    if (line[0] != 'U') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    int64_t guiMs = 0;
+    int64_t telemetryMs = 0;
+    const bool ok = parseInt(cursor, guiMs) && parseInt(cursor, telemetryMs) && guiMs >= 1 && guiMs <= 10000
+                    && telemetryMs >= 1 && telemetryMs <= 60000;
+    if (ok) {
+        guiPeriodMs = static_cast<unsigned int>(guiMs);
+        telemetryPeriodMs = static_cast<unsigned int>(telemetryMs);
+    }
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// Shows and logs a new difference between the DUT and us
+// A divergence also freezes and dumps the flight recorder (held off, see
+// auto_dump)
+auto report_dut(unsigned int nowMs) -> void {
+    setControlValue(panelIndex,dutDiffNumberIndex,dut.difference);
+    setControlValue(panelIndex,dutDivergedNumberIndex,static_cast<int>(dut.firstDivergenceMs));
+    recorder.event(nowMs, engine.transitionCount, RecordKind::mismatch, dut.difference);
+    if (dut.difference != 0) {
+        auto_dump(FreezeReason::mismatch, nowMs);
+    }
+    TextLine line;
+    line.put('D').putInt(nowMs).putInt(engine.transitionCount).putInt(dut.lastCount).putInt(dut.difference);
+    if (!dutLog.add(line, nowMs)) {
+        dutLog.flush(DUT_LOG_FILE);
+        dutLog.add(line, nowMs);
+    }
+}
+
+// Sets up the DUT readback from the PC:
+// "D <link> <counter bytes> <edges per count> [a] [b]"
+// link is N (off), U (UART), I (I2C, a = address, b = register)
+// or S (SPI, a = command byte)
+// The UART link takes the UART away from the PC until the next "D" line,
+// the "K" is the last thing the PC gets, see dut_readback.h
+auto handle_dut_line(const char* line) -> bool {
+    if (line[0] != 'D') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    while (*cursor == ' ') {
+        cursor++;
+    }
+    DutLink link = DutLink::none;
+    switch (*cursor) {
+    case 'U': link = DutLink::uart; break;
+    case 'I': link = DutLink::i2c; break;
+    case 'S': link = DutLink::spi; break;
+    default: break;
+    }
+    if (*cursor != '\0') {
+        cursor++;
+    }
+    int64_t bytes = 4;
+    int64_t edgesPerCount = 1;
+    int64_t a = 0;
+    int64_t b = 0;
+    parseInt(cursor, bytes);
+    parseInt(cursor, edgesPerCount);
+    const bool haveA = parseInt(cursor, a);
+    const bool haveB = parseInt(cursor, b);
+    const bool ok = bytes >= 1 && bytes <= 4 && (edgesPerCount == 1 || edgesPerCount == 2 || edgesPerCount == 4);
+    if (ok) {
+        dut.link = link;
+        dut.counterBytes = static_cast<int>(bytes);
+        dut.edgesPerCount = static_cast<int>(edgesPerCount);
+        if (link == DutLink::i2c && haveA) {
+            dut.i2cAddress = static_cast<int>(a);
+            dut.i2cRegister = haveB ? static_cast<int>(b) : 0;
+        }
+        if (link == DutLink::spi && haveA) {
+            dut.spiCommand = static_cast<unsigned char>(a);
+        }
+        dut.restart();
+        setControlValue(panelIndex,dutDiffNumberIndex,0);
+        setControlValue(panelIndex,dutDivergedNumberIndex,0);
+    }
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// Roughly how long one pin write takes, in ns
+auto measure_write_ns() -> unsigned int {
+    const unsigned int start = millis();
+    uint64_t writes = 0;
+    unsigned int elapsed = 0;
+    do {
+        hold_pins(256);
+        writes += 256;
+        elapsed = millis() - start;
+    } while(elapsed < GLITCH_CALIBRATE_MS);
+    return static_cast<unsigned int>(static_cast<uint64_t>(elapsed) * 1000000 / writes);
+}
+
+// Filter probe, see glitch.h: a pulse about "width" writes wide on one
+// channel, with an edge on the other one in the middle of it
+auto glitch_probe(int width) -> void {
+    quadratureNextTick(1);
+    hold_pins(width / 2);
+    quadratureNextTick(1);
+    hold_pins(width - width / 2);
+    quadratureNextTick(1);
+}
+
+// Pass probe, see glitch.h: a burst of steps "spacing" writes apart
+auto pass_probe(int spacing) -> void {
+    for(int step=0;step<GLITCH_PASS_STEPS;step++){
+        quadratureNextTick(1);
+        hold_pins(spacing);
+    }
+}
+
+// Adds a glitch search probe to the log list
+auto show_glitch_probe(char kind, int width, bool counted) -> void {
+    TextLine row;
+    row.put(kind).putInt(width).putWord(counted ? "ok" : "lost");
+    row.buffer[row.length] = '\0';
+    setLogDataText(GLITCH_LOG, reinterpret_cast<const char*>(row.buffer));
+}
+
+// Glitch filter threshold search
+// Finds the narrowest filter probe and the tightest pass probe spacing the
+// DUT still counts (see glitch.h), one probe at a time with a DUT read
+// before and after each. Shows every probe on the glitch panel and
+// appends the result to GLITCH_FILE. The probes themselves block for a
+// few ms at most, the waits for the DUT don't. Stopping the encoder by
+// hand ends the search.
+auto glitch_search(Sequencer& seq) -> Sequence {
+    glitchSearching = true;
+    engine.stopSimulation = true;
+    clearLogOrPlotData(GLITCH_LOG+1,0);
+    const unsigned int startedMs = millis();
+    const uint32_t stops = handStops;
+    const unsigned int settleMs = 2*dut.periodMs + dut.uartTimeoutMs;
+    const unsigned int nsPerWrite = measure_write_ns();
+    setControlValue(glitchPanelIndex,glitchNsNumberIndex,static_cast<int>(nsPerWrite));
+    uint16_t thresholds[2] = {0, 0};
+
+    for (int kind = 0; kind < 2; kind++) {
+        ThresholdSearch search;
+        search.start(GLITCH_MAX_WRITES);
+        while (!search.done()) {
+            const uint16_t width = search.probe();
+            setControlValue(glitchPanelIndex,glitchWidthNumberIndex,width);
+            // Whatever the DUT says before the probe is the zero
+            dut.restart();
+            co_await seq.after(settleMs);
+            const uint32_t readsBefore = dut.reads;
+            if (handStops != stops) {
+                glitchSearching = false;
+                co_return;
+            }
+            if (kind == 0) {
+                glitch_probe(width);
+            } else {
+                pass_probe(width);
+            }
+            co_await seq.after(settleMs);
+            if (handStops != stops) {
+                glitchSearching = false;
+                co_return;
+            }
+            if (!dut.aligned || dut.reads == readsBefore) {
+                // The DUT stopped answering, nothing to search on
+                show_glitch_probe('?', width, false);
+                glitchSearching = false;
+                co_return;
+            }
+            const bool counted = dut.difference == 0;
+            show_glitch_probe(kind == 0 ? 'f' : 'p', width, counted);
+            search.report(counted);
+        }
+        thresholds[kind] = search.threshold();
+        setControlValue(glitchPanelIndex,kind == 0 ? glitchFilterNumberIndex : glitchPassNumberIndex,
+                        thresholds[kind]);
+    }
+
+    const int handle = openFile(GLITCH_FILE, FILE_MODE_APPEND);
+    if (handle >= 0) {
+        TextLine line;
+        line.put('G').putInt(startedMs).putInt(nsPerWrite).putInt(thresholds[0]).putInt(thresholds[1])
+            .writeFile(handle);
+        closeFile(handle);
+    }
+    glitchSearching = false;
+}
+
+// Starts a glitch search and shows its panel
+// Same rules as start_characterization(), and the two don't mix
+auto start_glitch_search() -> bool {
+    if (encoder_busy() || dut.link == DutLink::none) {
+        return false;
+    }
+    if (!glitch_search(sequencer).started) {
+        return false;
+    }
+    showPanel(glitchPanelIndex);
+    shownPanel = glitchPanelIndex;
+    return true;
+}
+
+// Moves at the search rate to "stopAt", pulsing the index on the way past
+// homeIndexAt. Both happen from the position queue, on the exact edge.
+// Returns false if the queue is full, or we're already there.
+auto home_approach(unsigned int rateMs, int32_t stopAt) -> bool {
+    if (stopAt == engine.transitionCount
+        || !schedule.addAtPosition(homeIndexAt, ScheduleAction::pulseIndex, 0, engine.transitionCount, true)
+        || !schedule.addAtPosition(stopAt, ScheduleAction::stop, 0, engine.transitionCount, true)) {
+        return false;
+    }
+    engine.direction = stopAt >= engine.transitionCount ? 1 : 0;
+    setControlValue(panelIndex,directionNumberIndex,engine.direction);
+    set_refresh_rate(rateMs);
+    start_simulation();
+    return true;
+}
+
+// Home cycle: emulates an axis finding its reference mark, so a
+// controller's homing can be checked end to end
+//  - search towards homeIndexAt at homeSearchMs
+//  - with a slow approach: overshoot by homeBackoff, come back the same
+//    distance before the index and cross it again at homeSlowMs
+//  - stop homeOffset past the index and zero everything there
+// Stopping, the index and the zeroing all happen on the exact edge. After
+// that the DUT (if there is one) is expected to read exactly 0 as well.
+// Stopping the encoder by hand ends the cycle where it is, unzeroed.
+auto home_axis(Sequencer& seq) -> Sequence {
+    homing = true;
+    engine.stopSimulation = true;
+    const uint32_t stops = handStops;
+    const int32_t toward = homeIndexAt >= engine.transitionCount ? 1 : -1;
+    const int32_t home = homeIndexAt + toward * homeOffset;
+    const bool slow = homeSlowMs != 0;
+    int32_t stopAt = slow ? homeIndexAt + toward * homeBackoff : home;
+    bool ok = home_approach(homeSearchMs, stopAt);
+    if (ok) {
+        co_await seq.untilPosition(stopAt);
+        ok = handStops == stops;
+    }
+    if (ok && slow) {
+        // Back off to before the index, then the slow approach
+        stopAt = homeIndexAt - toward * homeBackoff;
+        engine.direction = toward > 0 ? 0 : 1;
+        setControlValue(panelIndex,directionNumberIndex,engine.direction);
+        ok = schedule.addAtPosition(stopAt, ScheduleAction::stop, 0, engine.transitionCount, true);
+        if (ok) {
+            start_simulation();
+            co_await seq.untilPosition(stopAt);
+            ok = handStops == stops;
+        }
+        if (ok) {
+            stopAt = home;
+            ok = home_approach(homeSlowMs, stopAt);
+        }
+        if (ok) {
+            co_await seq.untilPosition(stopAt);
+            ok = handStops == stops;
+        }
+    }
+    if (ok) {
+        preset_position(0);
+        if (dut.link != DutLink::none) {
+            dut.expectSameCount();
+        }
+    } else if (handStops != stops) {
+        // Whatever the approach it was on left in the position queue
+        // mustn't fire the next time the encoder gets there
+        schedule.removeAtPosition(homeIndexAt, ScheduleAction::pulseIndex);
+        schedule.removeAtPosition(stopAt, ScheduleAction::stop);
+    }
+    engine.stopSimulation = true;
+    homing = false;
+}
+
+// Starts a home cycle, unless one (or a characterization or glitch
+// search) is already moving the encoder
+auto start_homing() -> bool {
+    if (encoder_busy()) {
+        return false;
+    }
+    return home_axis(sequencer).started;
+}
+
+// "H <index at> <search ms> <slow ms> <offset> <backoff>" sets up the home
+// cycle, any numbers left out stay as they were. "H" alone starts one.
+// Answers "K 1" or "K 0".
+auto handle_home_line(const char* line) -> bool {
+    if (line[0] != 'H') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    int64_t values[5] = {homeIndexAt, homeSearchMs, homeSlowMs, homeOffset, homeBackoff};
+    int count = 0;
+    while (count < 5 && parseInt(cursor, values[count])) {
+        count++;
+    }
+    bool ok = values[1] >= 1 && values[2] >= 0 && values[3] >= 0 && values[4] >= 1;
+    if (ok && count == 0) {
+        ok = start_homing();
+    } else if (ok) {
+        homeIndexAt = static_cast<int32_t>(values[0]);
+        homeSearchMs = static_cast<unsigned int>(values[1]);
+        homeSlowMs = static_cast<unsigned int>(values[2]);
+        homeOffset = static_cast<int32_t>(values[3]);
+        homeBackoff = static_cast<int32_t>(values[4]);
+    }
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// Random walk: every WALK_UPDATE_MS the walk picks the next velocity and
+// it becomes the 1/4 period and direction, see random_walk.h. The edges
+// never come faster than the walk's maximum rate:
+//  - the 1/4 period is rounded up
+//  - a new 1/4 period only starts from the next edge
+//  - starting again after a stop isn't start_simulation(), the first
+//    edge is still a whole 1/4 period after the last one
+auto random_walk(Sequencer& seq, uint32_t run) -> Sequence {
+    while (walking && run == walkRun) {
+        const int32_t velocity = walk.update(engine.transitionCount);
+        const uint32_t rateMs = RandomWalk::rateMs(velocity);
+        if (rateMs == 0) {
+            engine.stopSimulation = true;
+        } else {
+            const int forwards = velocity > 0 ? 1 : 0;
+            if (forwards != engine.direction) {
+                engine.direction = forwards;
+                setControlValue(panelIndex,directionNumberIndex,engine.direction);
+            }
+            if (rateMs != engine.sensorRefreshRate) {
+                set_refresh_rate(rateMs);
+            }
+            if (engine.stopSimulation) {
+                engine.stopSimulation = false;
+                const unsigned int nowMs = millis();
+                if (engine.due(nowMs)) {
+                    engine.sensorOldMillis = nowMs;
+                }
+            }
+        }
+        co_await seq.after(WALK_UPDATE_MS);
+    }
+    if (run == walkRun) {
+        engine.stopSimulation = true;
+        walking = false;
+    }
+}
+
+// "W <seed> <max edges/s> <accel> <low> <high>" starts a random walk in
+// the position window low..high, accel is the most the velocity changes
+// by per update (edges/s). "W" alone stops it, so does Blue. Answers
+// "K 1" or "K 0".
+auto handle_walk_line(const char* line) -> bool {
+    if (line[0] != 'W') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    int64_t values[5] = {};
+    int count = 0;
+    while (count < 5 && parseInt(cursor, values[count])) {
+        count++;
+    }
+    bool ok = false;
+    if (count == 0) {
+        ok = walking;
+        walkRun++;
+        walking = false;
+        engine.stopSimulation = true;
+    } else if (count == 5 && !encoder_busy() && values[0] >= 0 && values[0] <= UINT32_MAX
+               && values[1] >= 1 && values[1] <= 1000 && values[2] >= 1 && values[2] <= 1000
+               && values[3] >= INT32_MIN && values[3] < values[4] && values[4] <= INT32_MAX) {
+        ok = walk.configure(static_cast<uint32_t>(values[0]), static_cast<int32_t>(values[1]),
+                            static_cast<int32_t>(values[2]), static_cast<int32_t>(values[3]),
+                            static_cast<int32_t>(values[4]));
+        if (ok) {
+            walkRun++;
+            walking = true;
+            engine.stopSimulation = true;
+            ok = random_walk(sequencer, walkRun).started;
+            walking = ok;
+        }
+    }
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// Shows where the move cycles are on their panel
+auto show_cycles() -> void {
+    setControlValue(cyclePanelIndex,cycleDoneNumberIndex,static_cast<int>(cycleTally.done));
+    setControlValue(cyclePanelIndex,cycleLeftNumberIndex,static_cast<int>(cycleTally.remaining()));
+    setControlValue(cyclePanelIndex,cycleErrorsNumberIndex,
+                    static_cast<int>(cycleTally.endErrors + cycleTally.dutErrors));
+    setControlValue(cyclePanelIndex,cycleJitterNumberIndex,static_cast<int>(cycleTally.jittered));
+    setControlValue(cyclePanelIndex,cycleMoveNumberIndex,static_cast<int>(cycleTally.lastMs[0]));
+}
+
+// Adds a line to the move cycle log list:
+// "E <cycle> <position>" a move that didn't stop on its target
+// "D <cycle> <DUT minus us>" the DUT didn't agree at the end of a move
+// "J <cycle> <ms>" a move more than jitterMs longer or shorter than the
+// last one the same way, by how much
+auto show_cycle_flag(char kind, uint32_t cycle, int32_t value) -> void {
+    TextLine row;
+    row.put(kind).putInt(cycle).putInt(value);
+    row.buffer[row.length] = '\0';
+    setLogDataText(CYCLE_LOG, reinterpret_cast<const char*>(row.buffer));
+}
+
+// Ends the move cycles where they are: stops the encoder, appends the
+// tally so far to CYCLE_FILE and puts the rate back
+auto finish_cycles() -> void {
+    cycleRun++;
+    cycling = false;
+    engine.stopSimulation = true;
+    show_cycles();
+    const int handle = openFile(CYCLE_FILE, FILE_MODE_APPEND);
+    if (handle >= 0) {
+        cycleTally.write(handle, cycleStartedMs, cycleProfile, cycleRunDwellMs);
+        closeFile(handle);
+    }
+    setControlValue(panelIndex,directionNumberIndex,engine.direction);
+    set_refresh_rate(cycleSavedRate);
+}
+
+// Point to point move cycles, see move_cycle.h: from where the encoder is
+// now, cycleProfile.distance forwards, dwell, back to the start, dwell,
+// cycleTally.cycles times. The profile's 1/4 period is set on every edge
+// for the one after next (the next deadline is already worked out), and
+// the move stops on its exact last edge. At every end the position has
+// to be exactly the target, and with a DUT its count has to agree after
+// the dwell (the dwell is made long enough for a fresh read).
+// "P" alone or a stop by hand ends the run with finish_cycles(), this
+// frame then only sees cycleRun has moved on and leaves everything alone.
+auto move_cycles(Sequencer& seq, uint32_t run) -> Sequence {
+    engine.stopSimulation = true;
+    clearLogOrPlotData(CYCLE_LOG+1,0);
+    cycleStartedMs = millis();
+    cycleSavedRate = engine.sensorRefreshRate;
+    const bool withDut = dut.link != DutLink::none;
+    const unsigned int settleMs = 2*dut.periodMs + dut.uartTimeoutMs;
+    const unsigned int dwellMs = withDut && cycleDwellMs < settleMs ? settleMs : cycleDwellMs;
+    cycleRunDwellMs = dwellMs;
+    const int32_t home = engine.transitionCount;
+    if (withDut) {
+        // Whatever the DUT says at rest is its zero
+        dut.restart();
+        co_await seq.after(settleMs);
+    }
+    show_cycles();
+
+    while (run == cycleRun && cycleTally.remaining() > 0) {
+        for (int forwards = 1; forwards >= 0 && run == cycleRun; forwards--) {
+            const int32_t target = forwards ? home + cycleProfile.distance : home;
+            engine.direction = forwards;
+            engine.sensorRefreshRate = cycleProfile.rateAt(1);
+            start_simulation();
+            unsigned int firstEdgeMs = 0;
+            for (int32_t edge = 1; run == cycleRun; edge++) {
+                co_await seq.nextEdge();
+                if (edge == 1) {
+                    firstEdgeMs = millis();
+                }
+                if (edge == cycleProfile.distance) {
+                    engine.stopSimulation = true;
+                    break;
+                }
+                engine.sensorRefreshRate = cycleProfile.rateAt(edge + 1);
+            }
+            if (run != cycleRun) {
+                break;
+            }
+            const unsigned int moveMs = millis() - firstEdgeMs;
+            if (engine.transitionCount != target) {
+                cycleTally.endErrors++;
+                show_cycle_flag('E', cycleTally.done, engine.transitionCount);
+            }
+            uint32_t stepMs = 0;
+            if (cycleTally.addMove(forwards != 0, moveMs, stepMs)) {
+                show_cycle_flag('J', cycleTally.done, static_cast<int32_t>(stepMs));
+            }
+            co_await seq.after(dwellMs);
+            if (run != cycleRun) {
+                break;
+            }
+            if (withDut) {
+                cycleTally.dutDifference = dut.difference;
+                if (dut.difference != 0) {
+                    cycleTally.dutErrors++;
+                    show_cycle_flag('D', cycleTally.done, dut.difference);
+                }
+            }
+        }
+        if (run == cycleRun) {
+            cycleTally.done++;
+            show_cycles();
+        }
+    }
+
+    if (run == cycleRun) {
+        finish_cycles();
+    }
+}
+
+// "P <distance> <cycles> <dwell ms> [<start ms> <cruise ms> <ramp edges>
+// <jitter ms>]" starts move cycles from where the encoder is and shows
+// their panel, the profile numbers left out stay as they were. "P" alone
+// stops them, so does Blue. Answers "K 1" or "K 0".
+auto handle_cycle_line(const char* line) -> bool {
+    if (line[0] != 'P') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    int64_t values[7] = {cycleProfile.distance, 0, cycleDwellMs, cycleProfile.startMs,
+                         cycleProfile.cruiseMs, cycleProfile.rampEdges, cycleTally.jitterMs};
+    int count = 0;
+    while (count < 7 && parseInt(cursor, values[count])) {
+        count++;
+    }
+    bool ok = false;
+    if (count == 0) {
+        // A frame waiting for an edge is woken to see it's over and leave
+        ok = cycling;
+        if (cycling) {
+            finish_cycles();
+            sequencer.wakeMotionWaits();
+        }
+    } else if (count >= 3 && !encoder_busy() && values[0] >= 1 && values[0] <= CYCLE_MAX_DISTANCE
+               && values[1] >= 1 && values[1] <= INT32_MAX && values[2] >= 0 && values[2] <= 600000
+               && values[3] >= 1 && values[3] <= 1000 && values[4] >= 1 && values[4] <= 1000
+               && values[5] >= 1 && values[5] <= 65535 && values[6] >= 0 && values[6] <= 65535) {
+        MoveProfile profile;
+        profile.distance = static_cast<int32_t>(values[0]);
+        profile.startMs = static_cast<uint16_t>(values[3]);
+        profile.cruiseMs = static_cast<uint16_t>(values[4]);
+        profile.rampEdges = static_cast<uint16_t>(values[5]);
+        ok = profile.valid();
+        if (ok) {
+            cycleProfile = profile;
+            cycleDwellMs = static_cast<unsigned int>(values[2]);
+            cycleTally.start(static_cast<uint32_t>(values[1]), profile.expectedMs(),
+                             static_cast<uint16_t>(values[6]));
+            cycleRun++;
+            cycling = true;
+            ok = move_cycles(sequencer, cycleRun).started;
+            cycling = ok;
+        }
+        if (ok) {
+            showPanel(cyclePanelIndex);
+            shownPanel = cyclePanelIndex;
+        }
+    }
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// Ends the plan where it is: stops the encoder, appends the tally so far
+// to PLAN_RUN_FILE and puts the rate back
+auto finish_plan() -> void {
+    planRun++;
+    playing = false;
+    engine.stopSimulation = true;
+    const int handle = openFile(PLAN_RUN_FILE, FILE_MODE_APPEND);
+    if (handle >= 0) {
+        planTally.write(handle, planStartedMs, plan);
+        closeFile(handle);
+    }
+    setControlValue(panelIndex,directionNumberIndex,engine.direction);
+    set_refresh_rate(planSavedRate);
+}
+
+// Plays the segment plan from where the encoder is, see segment_plan.h.
+// The player is always one edge ahead: when an edge is out, the next
+// one's direction is set and the 1/4 period after it (the deadline of
+// the next one is already worked out). While a plan plays the loop counts
+// every deadline from the last one, not from when the edge went out, so
+// the edges come on the plan's deadlines to the ms, dwells included, and
+// takenMs only drifts from plannedMs after a deadline miss. After the last
+// edge of every segment the count has to be exactly on that segment's
+// target.
+// "S" alone or a stop by hand ends the plan with finish_plan(), this
+// frame then only sees planRun has moved on and leaves everything alone.
+auto play_plan(Sequencer& seq, uint32_t run) -> Sequence {
+    engine.stopSimulation = true;
+    planStartedMs = millis();
+    planSavedRate = engine.sensorRefreshRate;
+    PlannedEdge edge;
+    bool more = planPlayer.next(edge);
+    if (planPlayer.leadMs > 0) {
+        co_await seq.after(planPlayer.leadMs);
+    }
+    if (run == planRun) {
+        engine.direction = edge.forwards ? 1 : 0;
+        setControlValue(panelIndex,directionNumberIndex,engine.direction);
+        engine.sensorRefreshRate = edge.gapMs;
+        start_simulation();
+    }
+    unsigned int firstEdgeMs = 0;
+    while (more && run == planRun) {
+        co_await seq.nextEdge();
+        if (run != planRun) {
+            break;
+        }
+        const unsigned int lastEdgeMs = millis();
+        if (planTally.edges == 0) {
+            firstEdgeMs = lastEdgeMs;
+        }
+        planTally.edges++;
+        planTally.takenMs = lastEdgeMs - firstEdgeMs;
+        if (edge.segmentEnd) {
+            planTally.segments++;
+            if (engine.transitionCount != edge.target) {
+                planTally.endErrors++;
+                recorder.event(lastEdgeMs, engine.transitionCount, RecordKind::mark, edge.target);
+            }
+        }
+        const uint32_t gapMs = edge.gapMs;
+        more = planPlayer.next(edge);
+        if (!more) {
+            engine.stopSimulation = true;
+            break;
+        }
+        planTally.plannedMs += gapMs;
+        engine.direction = edge.forwards ? 1 : 0;
+        engine.sensorRefreshRate = edge.gapMs;
+    }
+
+    if (run == planRun) {
+        finish_plan();
+    }
+}
+
+// Replaces the plan with the one in PLAN_FILE: "S+" lines, blank lines
+// and "#" comments. False (and an empty plan) if it can't be read or a
+// line is wrong.
+auto load_plan() -> bool {
+    plan.clear();
+    const int handle = openFile(PLAN_FILE, FILE_MODE_READ);
+    if (handle < 0) {
+        return false;
+    }
+    const int size = getFileSize(handle);
+    bool ok = true;
+    char text[TEXT_LINE_MAX];
+    while (ok && getFilePosition(handle) < size) {
+        int bytes = TEXT_LINE_MAX - 1;
+        readFileLine(handle, text, &bytes);
+        if (bytes <= 0) {
+            break;
+        }
+        while (bytes > 0 && (text[bytes - 1] == '\n' || text[bytes - 1] == '\r')) {
+            bytes--;
+        }
+        text[bytes] = '\0';
+        if (bytes > 0 && text[0] != '#') {
+            ok = text[0] == 'S' && text[1] == '+' && plan.addText(text + 2);
+        }
+    }
+    closeFile(handle);
+    if (!ok) {
+        plan.clear();
+    }
+    return ok;
+}
+
+// Segment plans, see segment_plan.h:
+// "S+ <segments>"  appends to the plan, as many segments as fit on the line
+// "S L"  replaces the plan with the one in PLAN_FILE
+// "S C"  clears the plan
+// "S G [passes]"  plays it from where the encoder is, once or "passes" times
+// "S"  stops it where it is, so does Blue
+// The plan can't be changed while it plays. Answers "K 1" or "K 0".
+auto handle_plan_line(const char* line) -> bool {
+    if (line[0] != 'S') {
+        return false;
+    }
+    const char* cursor = line + 1;
+    bool ok = false;
+    if (*cursor == '+') {
+        ok = !playing && plan.addText(cursor + 1);
+    } else {
+        while (*cursor == ' ') {
+            cursor++;
+        }
+        const char what = *cursor;
+        if (what != '\0') {
+            cursor++;
+        }
+        int64_t passes = 1;
+        parseInt(cursor, passes);
+        if (what == '\0') {
+            // A frame waiting for an edge is woken to see it's over and leave
+            ok = playing;
+            if (playing) {
+                finish_plan();
+                sequencer.wakeMotionWaits();
+            }
+        } else if (what == 'C' && !playing) {
+            plan.clear();
+            ok = true;
+        } else if (what == 'L' && !playing) {
+            ok = load_plan();
+        } else if (what == 'G' && !encoder_busy() && passes >= 1 && passes <= UINT32_MAX) {
+            ok = planPlayer.start(plan, static_cast<uint32_t>(passes), engine.transitionCount);
+            if (ok) {
+                planTally = PlanTally{};
+                planTally.passes = static_cast<uint32_t>(passes);
+                planRun++;
+                playing = true;
+                ok = play_plan(sequencer, planRun).started;
+                playing = ok;
+            }
+        }
+    }
+    TextLine reply;
+    reply.put('K').putInt(ok ? 1 : 0).sendUart();
+    return true;
+}
+
+// Adds a characterization step to the log list and the plot
+// Kept out of characterize_dut() so the line buffer isn't in its frame
+auto show_char_step(const CharacterizationStep& step) -> void {
+    TextLine row;
+    row.putInt(step.rateMs).putInt(step.achievedEdgesPerSecond).putInt(step.forwardError).putInt(step.netError);
+    row.buffer[row.length] = '\0';
+    setLogDataText(CHAR_LOG, reinterpret_cast<const char*>(row.buffer));
+    setPlotData(CHAR_PLOT_DATA,1,step.forwardError);
+}
+
+// Count error vs frequency characterization
+// At every rate in CHAR_RATES_MS: move CHAR_COUNTS ticks forwards, stop
+// and read the DUT, move back, stop and read it again. Builds the table on
+// the characterization panel and appends it to CHAR_FILE. Runs as a
+// sequence, the encoder engine does all the moving. Stopping the encoder
+// by hand ends it early, without a table in the file.
+auto characterize_dut(Sequencer& seq) -> Sequence {
+    characterizing = true;
+    charTable.clear();
+    clearLogOrPlotData(CHAR_LOG+1,CHAR_PLOT_DATA+1);
+    const unsigned int startedMs = millis();
+    const unsigned int savedRate = engine.sensorRefreshRate;
+    const uint32_t stops = handStops;
+    // Long enough for a fresh DUT read once the encoder has stopped
+    const unsigned int settleMs = 2*dut.periodMs + dut.uartTimeoutMs;
+    engine.stopSimulation = true;
+
+    for (const uint16_t rateMs : CHAR_RATES_MS) {
+        set_refresh_rate(rateMs);
+        // Whatever the DUT says at rest is the zero for this step
+        dut.restart();
+        co_await seq.after(settleMs);
+        const uint32_t readsBefore = dut.reads;
+        const int32_t start = engine.transitionCount;
+        if (handStops != stops) {
+            break;
+        }
+
+        engine.direction = 1;
+        const unsigned int moveStartMs = millis();
+        start_simulation();
+        co_await seq.untilPosition(start + CHAR_COUNTS);
+        engine.stopSimulation = true;
+        const unsigned int moveMs = millis() - moveStartMs;
+        co_await seq.after(settleMs);
+        const int32_t forwardError = dut.difference;
+        if (handStops != stops) {
+            break;
+        }
+
+        engine.direction = 0;
+        start_simulation();
+        co_await seq.untilPosition(start);
+        engine.stopSimulation = true;
+        co_await seq.after(settleMs);
+        if (handStops != stops) {
+            break;
+        }
+
+        const auto achieved = static_cast<uint16_t>(CHAR_COUNTS*1000/static_cast<int>(moveMs == 0 ? 1 : moveMs));
+        show_char_step(charTable.add(rateMs, achieved, forwardError, dut.difference,
+                                     dut.reads > readsBefore + 1));
+    }
+
+    if (handStops == stops) {
+        setControlValue(charPanelIndex,charMaxNumberIndex,charTable.maxReliableEdgesPerSecond());
+        const int handle = openFile(CHAR_FILE, FILE_MODE_APPEND);
+        if (handle >= 0) {
+            charTable.write(handle, startedMs, CHAR_COUNTS);
+            closeFile(handle);
+        }
+    }
+    engine.direction = 1;
+    setControlValue(panelIndex,directionNumberIndex,engine.direction);
+    set_refresh_rate(savedRate);
+    characterizing = false;
+}
+
+// Starts a characterization and shows its panel
+// It needs a DUT link to read back from, and only one can run at a time
+// Returns false if it didn't start
+auto start_characterization() -> bool {
+    if (encoder_busy() || dut.link == DutLink::none) {
+        return false;
+    }
+    if (!characterize_dut(sequencer).started) {
+        return false;
+    }
+    showPanel(charPanelIndex);
+    shownPanel = charPanelIndex;
+    return true;
+}
+
+// Stops the encoder from the buttons, and any run that was moving it
+// A run waiting for a position it won't get to now is woken up so it can
+// see handStops changed and finish
+auto stop_by_hand() -> void {
+    engine.stopSimulation = true;
+    handStops++;
+    walkRun++;
+    walking = false;
+    if (cycling) {
+        finish_cycles();
+    }
+    if (playing) {
+        finish_plan();
+    }
+    sequencer.wakeMotionWaits();
+}
+
+// Sends one telemetry frame to the PC:
+// "T <deviceMs> <pcMicros> <uncertaintyMicros> <ticks> <revs>"
+// pcMicros and uncertainty are "-" until the PC has answered a ping
+auto sendTelemetry(unsigned int nowMs, int ticks, int revs) -> void {
+    TextLine frame;
+    frame.put('T').putInt(nowMs);
+    int64_t pcUs = 0;
+    uint32_t uncertaintyUs = 0;
+    if (timeSync.pcMicros(nowMs, pcUs, uncertaintyUs)) {
+        frame.putInt(pcUs).putInt(uncertaintyUs);
+    } else {
+        frame.putWord("-").putWord("-");
+    }
+    frame.putInt(ticks).putInt(revs).sendUart();
+}
+
+// Handles everything the PC sent us since the last loop
+auto process_uart(unsigned int nowMs) -> void {
+    while (uartReader.poll()) {
+        bool dutChanged = false;
+        if (dut.handleLine(uartReader.line, engine.transitionCount, nowMs, dutChanged)) {
+            if (dutChanged) {
+                report_dut(nowMs);
+            }
+            continue;
+        }
+        if (handle_dut_line(uartReader.line)) {
+            continue;
+        }
+        // The UART is the DUT's, nothing else it says is for us
+        if (dut.link == DutLink::uart) {
+            continue;
+        }
+        if (timeSync.handleLine(uartReader.line, nowMs)) {
+            continue;
+        }
+        if (handle_dac_line(uartReader.line)) {
+            continue;
+        }
+        if (handle_home_line(uartReader.line)) {
+            continue;
+        }
+        if (handle_scale_line(uartReader.line)) {
+            continue;
+        }
+        if (handle_rates_line(uartReader.line)) {
+            continue;
+        }
+        if (handle_walk_line(uartReader.line)) {
+            continue;
+        }
+        if (handle_cycle_line(uartReader.line)) {
+            continue;
+        }
+        if (handle_plan_line(uartReader.line)) {
+            continue;
+        }
+        if (handle_schedule_line(uartReader.line, nowMs)) {
+            continue;
+        }
+        // "C" starts a characterization run
+        if (uartReader.line[0] == 'C') {
+            TextLine ack;
+            ack.put('K').putInt(start_characterization() ? 1 : 0).sendUart();
+            continue;
+        }
+        // "G" starts a glitch filter threshold search
+        if (uartReader.line[0] == 'G') {
+            TextLine ack;
+            ack.put('K').putInt(start_glitch_search() ? 1 : 0).sendUart();
+            continue;
+        }
+        // "R" dumps the flight recorder over the UART
+        if (uartReader.line[0] == 'R') {
+            start_dump(FreezeReason::request, DumpTarget::uart);
+            continue;
+        }
+        // "M" asks for the memory report:
+        // "M <arena used> <arena size> <arena limit> <static used> <static limit>"
+        if (uartReader.line[0] == 'M') {
+            TextLine report;
+            report.put('M').putInt(static_cast<int64_t>(appArena.usedBytes()))
+                  .putInt(static_cast<int64_t>(appArena.capacity()))
+                  .putInt(static_cast<int64_t>(ARENA_CAPACITY))
+                  .putInt(static_cast<int64_t>(staticBytesUsed()))
+                  .putInt(static_cast<int64_t>(STATIC_BYTES))
+                  .sendUart();
+        }
+    }
+    if (dut.link != DutLink::uart) {
+        timeSync.pollPing(nowMs);
+    }
+}
+
+// How long every benchmark measurement runs for
+const unsigned int BENCHMARK_CASE_MS = 500;
+// Edges run between looks at the clock
+const int BENCHMARK_BATCH = 256;
+// Every run is appended here, one line per configuration:
+// "<name> <compute edges/s> <pin edges/s> <loop edges/s>"
+const char* const BENCHMARK_FILE = "quadbench.txt";
+
+// Runs edges back to back for about BENCHMARK_CASE_MS and returns edges/s
+// The engine is handed a synthetic clock that moves exactly one 1/4 period
+// per edge, so nothing waits on the real time.
+// withPins: write the pins (setIO) or skip them
+// withLoop: also do what the real loop does per edge (waitms + GUI)
+auto benchmark_edges(bool withPins, bool withLoop) -> unsigned int {
+    pinOutputEnabled = withPins;
+    unsigned int syntheticMillis = 0;
+    uint64_t edges = 0;
+    const unsigned int start = millis();
+    unsigned int elapsed = 0;
+    do {
+        for(int i=0;i<BENCHMARK_BATCH;i++){
+            if(withLoop){
+                waitms(1);
+                setControlValue(panelIndex,transitionNumIndex,engine.transitionCount);
+                setControlValue(panelIndex,totalRefsNumberIndex,engine.totalRefs);
+                setPlotData(1,1,engine.sensorState[0]);
+                setPlotData(0,1,engine.sensorState[1]);
+            }
+            quadratureNextTick(engine.direction);
+            run_position_commands();
+            run_time_commands(syntheticMillis);
+            syntheticMillis += engine.sensorRefreshRate;
+        }
+        edges += BENCHMARK_BATCH;
+        elapsed = millis() - start;
+    } while(elapsed < BENCHMARK_CASE_MS);
+    pinOutputEnabled = true;
+    return static_cast<unsigned int>(edges * 1000 / elapsed);
+}
+
+// Diagnostic mode: measures how fast the engine can go in every
+// configuration, shows the results on the bench panel and appends
+// them to BENCHMARK_FILE. The encoder state is put back afterwards.
+auto run_benchmark() -> void {
+    const QuadratureEngine savedEngine = engine;
+    const LinearScale savedScale = scale;
+    // Scheduled commands must not fire during the benchmark,
+    // but the (empty) queues are still checked on every edge
+    const CommandSchedule savedSchedule = schedule;
+    schedule.clear();
+
+    showDialogProgressBar("Benchmarking", 0, 0, 0);
+    const int handle = openFile(BENCHMARK_FILE, FILE_MODE_APPEND);
+    TextLine line;
+    if(handle >= 0){
+        line.putWord("bench").putInt(millis()).writeFile(handle);
+    }
+    for(size_t row=0;row<benchmarkCases.size();row++){
+        engine.direction = benchmarkCases[row].direction;
+        // The scale as it was set up, or the default one
+        scale.enabled = false;
+        engine.countRevolutions = true;
+        if(benchmarkCases[row].linearScale){
+            scale.configure(savedScale.periodNm, savedScale.spacing, engine.transitionCount);
+            engine.countRevolutions = false;
+        }
+        const unsigned int rates[3] = {benchmark_edges(false,false),
+                                       benchmark_edges(true,false),
+                                       benchmark_edges(true,true)};
+        line.putWord(benchmarkCases[row].name);
+        for(int column=0;column<3;column++){
+            setControlValue(benchPanelIndex,benchNumberIndex+static_cast<int>(row)*3+column,static_cast<int>(rates[column]));
+            line.putInt(rates[column]);
+        }
+        if(handle >= 0){
+            line.writeFile(handle);
+        }
+        line.length = 0;
+        showDialogProgressBar("Benchmarking", 0, static_cast<int>((row+1)*100/benchmarkCases.size()), 0);
+    }
+    if(handle >= 0){
+        closeFile(handle);
+    }
+
+    engine = savedEngine;
+    scale = savedScale;
+    schedule = savedSchedule;
+    // Put the pins back where the encoder left them
+    indexPulseActive = false;
+    setIO(PinA,engine.sensorState[0]);
+    setIO(PinB,engine.sensorState[1]);
+    setIO(PinIndex,0);
+    showPanel(benchPanelIndex);
 }
 
 // Process all the events forever
@@ -286,34 +2054,10 @@ auto quadratureNextTick(int direction) -> void{
 // Essentially become the main "loop" like Arduino
 auto process_events() -> void {
 
-    // Flag to continue simulating or to stop the encoder simulation
-    // Stops the simulation of the quadrature encoder when it is true
-    // By default it starts in the stopped state
-    bool stopSimulation = 1;
-
-    // Transition counter WILL OVERFLOW IF LEFT FOR TOO LONG
-    // Stores the number of transitions that either pinA or pinB has 
-    // Every time we update the "encoder" pins this value changes 
-    // so the encoder frequency is this number/4.
-    int transitionCount = 0;
-
-    // Temporary counter to determine when
-    // to increment the revolution counter
-    // It is equal to 4*number of teeth*revs/s
-    int revTickThreshold = 4*static_cast<int>(numberTeeth)*static_cast<int>(revPerSecond);
-    // Counter to hold number of ticks since last update to the 
-    // total revolution counter
-    int revTickCount = 0;
-    
-    // Stores the state of the pins
-    // pinA is index 0, and pinB is index 1
-    int sensorState[2] = {0};
     // Set the initial state of pinA and B
-    setIO(PinA,sensorState[0]);
-    setIO(PinB,sensorState[1]);
-    
-
-
+    setIO(PinA,engine.sensorState[0]);
+    setIO(PinB,engine.sensorState[1]);
+    setIO(PinIndex,0);
 
     while (true) {
 
@@ -324,43 +2068,39 @@ auto process_events() -> void {
         // of either PinA or PinB
         // Change only if we need to change the sensors
         // Driven by the sensor refresh rate
-        if(millis()>=sensorOldMillis && !stopSimulation){
-            sensorOldMillis = millis()+sensorRefreshRate;
-            sensorState[0]  = nextStateTable[nextStateIndex][0];
-            sensorState[1]  = nextStateTable[nextStateIndex][1];
-            setIO(PinA,sensorState[0]);
-            setIO(PinB,sensorState[1]);
-
-            // Increment the next state index, and reset to proper index
-            // if out of array bounds
-            if(direction){
-                nextStateIndex++;
-                //Increase the transition counter
-                transitionCount++;
-                // Increase total revolution tick counter
-                revTickCount++;
+        if(engine.due(millis())){
+            const auto edgeMillis = engine.sensorOldMillis;
+            const unsigned int edgeNow = millis();
+            quadratureNextTick(engine.direction);
+            recorder.edge(edgeNow, engine.transitionCount, engine.direction != 0);
+            trend.edge(edgeNow, engine.transitionCount);
 
-            }else{
-                nextStateIndex--;
-                transitionCount--;
-                revTickCount--;
-            }
-            if(nextStateIndex>3){
-                nextStateIndex = 0;
-            }
-            if(nextStateIndex<0){
-                nextStateIndex = 3;
+            // An edge a whole period late means one was lost, keep the
+            // recorder's view of what led up to it
+            const unsigned int lateness = edgeNow - edgeMillis;
+            const bool missed = lateness >= engine.sensorRefreshRate && lateness >= MISSED_DEADLINE_MIN_MS;
+            if (missed) {
+                recorder.event(edgeNow, engine.transitionCount, RecordKind::deadlineMiss, static_cast<int32_t>(lateness));
+                auto_dump(FreezeReason::deadlineMiss, edgeNow);
             }
 
-            // Increment or decrement number of revolutions
-            if(revTickCount==revTickThreshold||revTickCount==-revTickThreshold){
-                revTickCount=0;
-                if(direction){
-                    totalRefs++;
-                }else{
-                    totalRefs--;
-                }
+            // Run whatever was scheduled for this position or the time
+            // this edge was due, before the next deadline is worked out
+            // so a new rate applies straight away
+            run_position_commands();
+            run_time_commands(edgeMillis);
+            // A plan keeps to its own deadlines, the next edge is due a 1/4
+            // period after this one was due, so a late edge doesn't make
+            // every edge after it late too. Only after a miss it starts
+            // over from now.
+            if (playing && !missed) {
+                engine.sensorOldMillis = edgeMillis+engine.sensorRefreshRate;
+            } else {
+                engine.sensorOldMillis = edgeNow+engine.sensorRefreshRate;
             }
+            // Sequences waiting on this edge or position go last,
+            // the pins are already out
+            sequencer.onEdge(engine.transitionCount);
 
             // Check if we are in any other mode and change the behavior as appropriate
 
@@ -371,23 +2111,60 @@ auto process_events() -> void {
             // To be honest, I do not know why this works, it just does...
             // The iSettings parameter (second parameter) does not seem to have
             // any use, it does not change anything that I can see.
-            setPlotData(1,1,sensorState[0]);
+            setPlotData(1,1,engine.sensorState[0]);
             //for(int x=2;x<6;x++)
             //    setPlotData(x,1,sensorState[1]);
         }
         
 
-        // Update the GUI's number of transititions
-        setControlValue(panelIndex,transitionNumIndex,transitionCount);
-        // Update the GUI's total number of revolutions
-        setControlValue(panelIndex,totalRefsNumberIndex,totalRefs);
-
-        // Keep adding values to the Plot "buffer" in order for the scrolling to show.
-        // It seems to work based on the # of values you add, aka every value
-        // causes the plot to scroll to the left
-        setPlotData(1,1,sensorState[0]); // Plot pinA's state
-        // Update the red line control plot
-        setPlotData(0,1,sensorState[1]); // Plot pinA's state
+        const unsigned int nowMs = millis();
+        if (nowMs - guiOldMillis >= guiPeriodMs) {
+            guiOldMillis = nowMs;
+            // Update the GUI's number of transititions
+            setControlValue(panelIndex,transitionNumIndex,engine.transitionCount);
+            // Update the GUI's total number of revolutions
+            setControlValue(panelIndex,totalRefsNumberIndex,engine.totalRefs);
+            if(scale.enabled){
+                setControlValue(panelIndex,scaleNumberIndex,static_cast<int>(scale.micrometres(engine.transitionCount)));
+            }
+
+            // Keep adding values to the Plot "buffer" in order for the scrolling to show.
+            // It seems to work based on the # of values you add, aka every value
+            // causes the plot to scroll to the left
+            setPlotData(1,1,engine.sensorState[0]); // Plot pinA's state
+            // Update the red line control plot
+            setPlotData(0,1,engine.sensorState[1]); // Plot pinA's state
+        }
+
+        // Talk to the PC: answer time sync and send telemetry
+        process_uart(nowMs);
+        dump_step();
+
+        // Read the DUT's counter, but only in the slack between edges so
+        // the readback never holds up the waveform it is checking
+        dut.checkTimeout(nowMs);
+        const auto slackMs = static_cast<int>(engine.sensorOldMillis - nowMs);
+        if (dut.due(nowMs) && (engine.stopSimulation || slackMs >= DUT_READ_SLACK_MS)) {
+            if (dut.read(nowMs, engine.transitionCount)) {
+                report_dut(nowMs);
+            }
+        }
+        if (dutLog.due(nowMs, DUT_LOG_FLUSH_MS) && (engine.stopSimulation || slackMs >= DUT_READ_SLACK_MS)) {
+            dutLog.flush(DUT_LOG_FILE);
+        }
+        if (dac.due(nowMs)) {
+            dac.update(nowMs, dac.phaseAt(engine.transitionCount, towards_next_edge(nowMs), engine.direction != 0));
+        }
+        // Timed commands also have to run while no edges are being made
+        run_time_commands(nowMs);
+        sequencer.onTime(nowMs);
+        if (trend.point(nowMs)) {
+            plot_trend();
+        }
+        if (nowMs - telemetryOldMillis >= telemetryPeriodMs && dut.link != DutLink::uart) {
+            telemetryOldMillis = nowMs;
+            sendTelemetry(nowMs, engine.transitionCount, engine.totalRefs);
+        }
         
         
         // If there are no events (button clicks/sensors)
@@ -399,6 +2176,7 @@ auto process_events() -> void {
         // Get the list of events that we need to process
         uint8_t event_data[FW_GET_EVENT_DATA_MAX] = {0};
         auto last_event = getEventData(event_data);
+        sequencer.onEvent(last_event);
 
         // If there is any event to edit numbers, go back to the main screen
         // as it is not supported now
@@ -425,26 +2203,61 @@ auto process_events() -> void {
         // about.
         // aka this function: setCanDisplayReactToButtons
 
+        recorder.event(millis(), engine.transitionCount, RecordKind::button, last_event);
+
+        // Yellow on the bench panel starts a characterization, Green a
+        // glitch search and Blue a home cycle, any other button there (or
+        // on their panels) goes back to the main panel. A run that was
+        // started keeps running.
+        if (shownPanel != panelIndex) {
+            bool started = false;
+            if (shownPanel == benchPanelIndex && last_event == FWGuiEventType::FWGUI_EVENT_YELLOW_BUTTON) {
+                started = start_characterization();
+            }
+            if (shownPanel == benchPanelIndex && last_event == FWGuiEventType::FWGUI_EVENT_GREEN_BUTTON) {
+                started = start_glitch_search();
+            }
+            // A home cycle shows on the main panel
+            if (shownPanel == benchPanelIndex && last_event == FWGuiEventType::FWGUI_EVENT_BLUE_BUTTON) {
+                start_homing();
+            }
+            if (!started) {
+                shownPanel = panelIndex;
+                showPanel(panelIndex);
+            }
+            continue;
+        }
+
         // When the Gray button is pressed, do not show the debug window!
-        if (last_event == FWGuiEventType::FWGUI_EVENT_GRAY_BUTTON) {
-            // Override the debug window that it usually pop ups with
-           showPanel(panelIndex);
+        // Instead run the self benchmark and show its results
+        if (last_event == FWGuiEventType::FWGUI_EVENT_GRAY_BUTTON && !encoder_busy()) {
+            run_benchmark();
+            shownPanel = benchPanelIndex;
+        }
 
+        // Yellow dumps the flight recorder to TRACE_FILE
+        if (last_event == FWGuiEventType::FWGUI_EVENT_YELLOW_BUTTON) {
+            start_dump(FreezeReason::request, DumpTarget::file);
         }
 
         // "Toggle" the simulation of the quadrature encoder when pressed
+        // While a run is moving it Blue only stops it, and the run with it
         if (last_event == FWGuiEventType::FWGUI_EVENT_BLUE_BUTTON) {
-           stopSimulation = !stopSimulation;
+           if (engine.stopSimulation && !encoder_busy()) {
+               start_simulation();
+           } else {
+               stop_by_hand();
+           }
         }
         // "Toggle" direction of the "quadrature"
-        if (last_event == FWGuiEventType::FWGUI_EVENT_GREEN_BUTTON) {
-            if(direction){
-                direction = 0;
+        if (last_event == FWGuiEventType::FWGUI_EVENT_GREEN_BUTTON && !encoder_busy()) {
+            if(engine.direction){
+                engine.direction = 0;
                 // Update the direction on the screen
-                setControlValue(panelIndex,directionNumberIndex,direction);
+                setControlValue(panelIndex,directionNumberIndex,engine.direction);
             }else{
-                direction = 1;
-                setControlValue(panelIndex,directionNumberIndex,direction);
+                engine.direction = 1;
+                setControlValue(panelIndex,directionNumberIndex,engine.direction);
             }
         }
         // If the button pressed was the RED button, then exit the application
@@ -460,10 +2273,12 @@ auto process_events() -> void {
 
 auto main() -> int {
 
+    engine.setTeeth(numberTeeth);
     // Setup the main panel 
     setup_panels();
     // Show a cool rainbow show of LED's :)
-    show_rainbow_leds(2);
+    // It carries on by itself once the loop below is running
+    show_rainbow_leds(sequencer, 2);
 
     // Process all the events indefinetly
     // functions just like loop() in Arduino
@@ -0,0 +1,155 @@
+// Bounded random walk of the encoder's velocity, for overnight soak runs
+//
+// Every update (WALK_UPDATE_MS) the velocity gets a random acceleration of
+// at most maxAccel, and now and then it stops for a while or turns round.
+// It never goes faster than maxRate, and it turns back before it gets to
+// either end of the position window: when the distance it needs to stop
+// (with a couple of updates to spare) would take it past the end, it
+// brakes at maxAccel and comes back.
+//
+// Everything is integer and the random numbers come from a xorshift32
+// seeded from the "W" line, so the same seed gives the same run and a
+// count error found overnight can be run again.
+//
+// velocity is in edges/s, the app turns it into the 1/4 period with
+// rateMs(), rounded up so the edges never come faster than asked.
+
+#pragma once
+
+#include <cstdint>
+
+// How often the velocity changes
+const uint32_t WALK_UPDATE_MS = 100;
+
+struct RandomWalk {
+    enum class Phase : uint8_t {
+        wander, // random accelerations
+        stopping, // braking to a stop, then dwell
+        dwelling, // stopped for "dwell" updates
+        turning, // braking through 0 to "target" the other way
+    };
+
+    uint32_t state = 1; // xorshift32, never 0
+    int32_t maxRate = 500; // edges/s
+    int32_t maxAccel = 50; // edges/s per update
+    int32_t low = -100000; // position window
+    int32_t high = 100000;
+    // Chance per update of a stop or a turn, in 1/1000
+    uint32_t stopPerMille = 5;
+    uint32_t turnPerMille = 5;
+
+    int32_t velocity = 0;
+    int32_t target = 0;
+    uint32_t dwell = 0;
+    Phase phase = Phase::wander;
+
+    // Starts a walk from standstill, false if the numbers don't make one
+    // maxRate is at most 1000, the engine's 1ms 1/4 period
+    auto configure(uint32_t seed, int32_t rate, int32_t accel, int32_t from, int32_t to) -> bool {
+        if (rate < 1 || rate > 1000 || accel < 1 || accel > rate || from >= to) {
+            return false;
+        }
+        maxRate = rate;
+        maxAccel = accel;
+        // The window has to hold a stop from full speed either way
+        if (static_cast<int64_t>(to) - from < 2 * stoppingDistance(rate)) {
+            return false;
+        }
+        state = seed != 0 ? seed : 1;
+        low = from;
+        high = to;
+        velocity = 0;
+        target = 0;
+        dwell = 0;
+        phase = Phase::wander;
+        return true;
+    }
+
+    auto next() -> uint32_t {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // 0 to range - 1
+    auto below(uint32_t range) -> uint32_t {
+        return static_cast<uint32_t>((static_cast<uint64_t>(next()) * range) >> 32);
+    }
+
+    // How far it goes (edges) before it can be stopped from "speed",
+    // if this update speeds it up by maxAccel first and then it brakes at
+    // maxAccel, with two updates to spare
+    auto stoppingDistance(int32_t speed) const -> int64_t {
+        const int64_t magnitude = (speed < 0 ? -speed : speed) + maxAccel;
+        const int64_t updates = (magnitude + maxAccel - 1) / maxAccel + 2;
+        return updates * magnitude * WALK_UPDATE_MS / 1000;
+    }
+
+    // Moves "velocity" towards "to" by at most maxAccel, true once there
+    auto approach(int32_t to) -> bool {
+        if (velocity < to) {
+            velocity = velocity + maxAccel < to ? velocity + maxAccel : to;
+        } else if (velocity > to) {
+            velocity = velocity - maxAccel > to ? velocity - maxAccel : to;
+        }
+        return velocity == to;
+    }
+
+    // The velocity for the next update, "position" is where the encoder is
+    auto update(int32_t position) -> int32_t {
+        // Heading out of the window (or already out): turn back, with
+        // the stop taken into account so it brakes in time
+        const int64_t ahead = static_cast<int64_t>(position) + (velocity < 0 ? -1 : 1) * stoppingDistance(velocity);
+        const bool outwards = (velocity > 0 && ahead >= high) || (velocity < 0 && ahead <= low)
+                              || (velocity >= 0 && position >= high) || (velocity <= 0 && position <= low);
+        const int32_t inwards = position >= high || (position > low && velocity > 0) ? -1 : 1;
+        if (outwards && (phase != Phase::turning || (target > 0 ? 1 : -1) != inwards)) {
+            phase = Phase::turning;
+            target = inwards * (static_cast<int32_t>(below(static_cast<uint32_t>(maxRate))) / 2 + 1);
+        }
+
+        switch (phase) {
+        case Phase::wander: {
+            const int32_t accel = static_cast<int32_t>(below(static_cast<uint32_t>(2 * maxAccel + 1))) - maxAccel;
+            velocity += accel;
+            velocity = velocity > maxRate ? maxRate : velocity < -maxRate ? -maxRate : velocity;
+            const uint32_t roll = below(1000);
+            if (roll < stopPerMille) {
+                phase = Phase::stopping;
+            } else if (roll < stopPerMille + turnPerMille && velocity != 0) {
+                phase = Phase::turning;
+                target = -velocity;
+            }
+            break;
+        }
+        case Phase::stopping:
+            if (approach(0)) {
+                phase = Phase::dwelling;
+                dwell = 1 + below(20);
+            }
+            break;
+        case Phase::dwelling:
+            if (--dwell == 0) {
+                phase = Phase::wander;
+            }
+            break;
+        case Phase::turning:
+            if (approach(target)) {
+                phase = Phase::wander;
+            }
+            break;
+        }
+        return velocity;
+    }
+
+    // 1/4 period for a velocity, 0 when stopped
+    // Rounded up: 1000 / rateMs is never more than |velocity|
+    static auto rateMs(int32_t speed) -> uint32_t {
+        if (speed == 0) {
+            return 0;
+        }
+        const auto magnitude = static_cast<uint32_t>(speed < 0 ? -speed : speed);
+        return (1000 + magnitude - 1) / magnitude;
+    }
+};
@@ -0,0 +1,207 @@
+// Flight recorder: the last few hundred edges and events, kept in RAM
+//
+// Logging every edge to flash is far too slow to leave on, but when
+// something goes wrong (a missed deadline, a count mismatch) we want to see
+// what happened just before. The recorder keeps writing into a ring of
+// small blocks and throws the oldest block away when it runs out. When
+// something goes wrong it is frozen and dumped (see quadrature.cpp).
+//
+// Every block starts with the absolute time and position, then one byte
+// per edge as long as edges are less than 127 ms apart:
+//   bit 7 = direction (1 forwards), bits 0-6 = ms since the last record
+// A byte with all of bits 0-6 set (127) is an escape, it is followed by
+//   kind byte, varint ms since the last record, and for events (kind > 0)
+//   a zigzag varint value
+// kind 0 is an edge that came too long after the last record.
+// Since every block starts from scratch, the dump can always start from
+// the oldest block left.
+
+#pragma once
+
+#include "text_line.h"
+#include <cstddef>
+#include <cstdint>
+
+// What went into the recorder besides edges
+enum class RecordKind : uint8_t {
+    slowEdge, // internal, an edge with a long gap before it
+    deadlineMiss, // value: how many ms late the edge was
+    button, // value: the GUI event
+    command, // value: the scheduled action that ran
+    mismatch, // value: device under test count minus ours
+    mark, // value: anything, for debugging
+    preset, // value: the position jumped to without edges
+};
+
+// Why the recorder was frozen
+enum class FreezeReason : uint8_t {
+    none,
+    request, // button or UART
+    deadlineMiss,
+    mismatch,
+};
+
+struct FlightRecorder {
+    static constexpr auto BLOCK_BYTES = 64;
+    static constexpr auto BLOCKS = 6;
+    static constexpr uint8_t ESCAPE = 0x7F;
+
+    struct Block {
+        uint32_t startMs = 0;
+        int32_t startPosition = 0;
+        uint8_t used = 0;
+        uint8_t data[BLOCK_BYTES - 9] = {};
+    };
+
+    Block blocks[BLOCKS] = {};
+    uint8_t current = 0;
+    uint8_t filled = 0; // blocks holding records, including current
+    uint32_t lastMs = 0;
+    FreezeReason frozen = FreezeReason::none;
+    uint32_t frozenAtMs = 0;
+
+    // Called for every edge, with the position after the edge
+    // The common case is a compare and a byte store
+    auto edge(uint32_t nowMs, int32_t position, bool forward) -> void {
+        const uint32_t delta = nowMs - lastMs;
+        Block& block = blocks[current];
+        if (delta < ESCAPE && block.used < sizeof(block.data) && filled != 0 && frozen == FreezeReason::none) {
+            block.data[block.used++] = static_cast<uint8_t>(delta | (forward ? 0x80u : 0u));
+            lastMs = nowMs;
+            return;
+        }
+        slowEdge(nowMs, position, forward);
+    }
+
+    auto event(uint32_t nowMs, int32_t position, RecordKind kind, int32_t value) -> void {
+        if (frozen != FreezeReason::none) {
+            return;
+        }
+        Block& block = room(nowMs, position, 12);
+        block.data[block.used++] = ESCAPE;
+        block.data[block.used++] = static_cast<uint8_t>(kind);
+        putVarint(block, nowMs - lastMs);
+        // zigzag, so small negative numbers stay small
+        putVarint(block, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+        lastMs = nowMs;
+    }
+
+    // Stops recording until reset(), the first reason sticks
+    auto freeze(FreezeReason reason, uint32_t nowMs) -> void {
+        if (frozen == FreezeReason::none) {
+            frozen = reason;
+            frozenAtMs = nowMs;
+        }
+    }
+
+    auto reset() -> void {
+        filled = 0;
+        frozen = FreezeReason::none;
+    }
+
+    // Number of blocks to dump, oldest is 0
+    auto blockCount() const -> int {
+        return filled;
+    }
+
+    // Decodes a block into text lines, handing each one to "emit":
+    //   "E <ms> <position>"  an edge, and where it left the encoder
+    //   "V <ms> <kind> <value>"  an event
+    template <typename Emit>
+    auto decodeBlock(int age, Emit emit) const -> void {
+        const Block& block = blocks[(current + BLOCKS - filled + 1 + age) % BLOCKS];
+        uint32_t ms = block.startMs;
+        int32_t position = block.startPosition;
+        int at = 0;
+        while (at < block.used) {
+            const uint8_t byte = block.data[at++];
+            const bool forward = (byte & 0x80) != 0;
+            TextLine line;
+            if ((byte & ESCAPE) != ESCAPE) {
+                ms += byte & ESCAPE;
+                position += forward ? 1 : -1;
+                line.put('E').putInt(ms).putInt(position);
+                emit(line);
+                continue;
+            }
+            const auto kind = static_cast<RecordKind>(block.data[at++]);
+            ms += getVarint(block, at);
+            if (kind == RecordKind::slowEdge) {
+                position += forward ? 1 : -1;
+                line.put('E').putInt(ms).putInt(position);
+            } else {
+                const uint32_t zigzag = getVarint(block, at);
+                const auto value = static_cast<int32_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+                line.put('V').putInt(ms).putInt(static_cast<int>(kind)).putInt(value);
+                if (kind == RecordKind::preset) {
+                    position = value;
+                }
+            }
+            emit(line);
+        }
+    }
+
+private:
+    // Edge that didn't fit the one byte form, or the first one in a block
+    auto slowEdge(uint32_t nowMs, int32_t position, bool forward) -> void {
+        if (frozen != FreezeReason::none) {
+            return;
+        }
+        Block& block = room(nowMs, forward ? position - 1 : position + 1, 7);
+        const uint32_t delta = nowMs - lastMs;
+        lastMs = nowMs;
+        if (delta < ESCAPE) {
+            block.data[block.used++] = static_cast<uint8_t>(delta | (forward ? 0x80u : 0u));
+            return;
+        }
+        block.data[block.used++] = static_cast<uint8_t>(ESCAPE | (forward ? 0x80u : 0u));
+        block.data[block.used++] = static_cast<uint8_t>(RecordKind::slowEdge);
+        putVarint(block, delta);
+    }
+
+    // Returns a block with at least "bytes" free, starting a new one
+    // (and dropping the oldest) if needed. "position" is where the encoder
+    // is before the record about to be written.
+    auto room(uint32_t nowMs, int32_t position, int bytes) -> Block& {
+        if (filled != 0 && blocks[current].used + bytes <= static_cast<int>(sizeof(Block::data))) {
+            return blocks[current];
+        }
+        if (filled != 0) {
+            current = static_cast<uint8_t>((current + 1) % BLOCKS);
+        }
+        if (filled < BLOCKS) {
+            filled++;
+        }
+        Block& block = blocks[current];
+        block.startMs = nowMs;
+        block.startPosition = position;
+        block.used = 0;
+        lastMs = nowMs;
+        return block;
+    }
+
+    static auto putVarint(Block& block, uint32_t value) -> void {
+        while (value >= 0x80) {
+            block.data[block.used++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        block.data[block.used++] = static_cast<uint8_t>(value);
+    }
+
+    static auto getVarint(const Block& block, int& at) -> uint32_t {
+        uint32_t value = 0;
+        int shift = 0;
+        while (at < block.used) {
+            const uint8_t byte = block.data[at++];
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+            shift += 7;
+        }
+        return value;
+    }
+};
+
+// Memory the recorder takes in the app arena (see arena.h)
+constexpr size_t FLIGHT_RECORDER_ARENA_BYTES = sizeof(FlightRecorder);
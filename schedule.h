@@ -0,0 +1,169 @@
+// Queue of commands to run at an exact time or encoder position
+// Lets a test script be sent ahead of time (over the UART) and played
+// back by the encoder itself, instead of depending on when the loop
+// happened to poll the UART or a button.
+//
+// Two queues in static memory:
+//  - time queue, kept sorted so the next command is always the last entry
+//  - position queue, kept sorted by position with a "split" marking where
+//    the current position falls, so the next command going forward is
+//    right above the split and the next one going backward right below it
+// Either way only one entry has to be looked at per edge.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// What a scheduled command does when it fires
+enum class ScheduleAction : uint8_t {
+    setRate, // value is the new 1/4 period in ms
+    reverse, // flip the direction
+    stop, // stop generating edges
+    start, // start generating edges again
+    pulseIndex, // raise the index pin until the next edge
+    preset, // value is the new position, no edges are made
+};
+
+struct ScheduledCommand {
+    int32_t at = 0; // millis() or encoder position, depending on the queue
+    ScheduleAction action = ScheduleAction::stop;
+    int32_t value = 0;
+    // Queued by a run that moves the encoder itself (the home cycle),
+    // it runs even while the PC's commands are held off
+    bool byRun = false;
+};
+
+struct CommandSchedule {
+    static constexpr auto CAPACITY = 8;
+
+    // Sorted latest first, so the next one to run is at the end
+    ScheduledCommand timeQueue[CAPACITY] = {};
+    uint8_t timeCount = 0;
+
+    // Sorted by position, smallest first
+    ScheduledCommand positionQueue[CAPACITY] = {};
+    uint8_t positionCount = 0;
+    // Number of entries at or below the current position
+    uint8_t positionSplit = 0;
+
+    auto clear() -> void {
+        timeCount = 0;
+        positionCount = 0;
+        positionSplit = 0;
+    }
+
+    // Adds a command to run once millis() reaches atMs
+    // Returns false if the queue is full
+    auto addAtTime(uint32_t atMs, ScheduleAction action, int32_t value, uint32_t nowMs) -> bool {
+        if (timeCount >= CAPACITY) {
+            return false;
+        }
+        // Compare relative to now so the millis() wrap doesn't matter
+        const uint32_t wait = atMs - nowMs;
+        int slot = timeCount;
+        while (slot > 0 && static_cast<int32_t>(static_cast<uint32_t>(timeQueue[slot - 1].at) - nowMs)
+                               <= static_cast<int32_t>(wait)) {
+            timeQueue[slot] = timeQueue[slot - 1];
+            slot--;
+        }
+        timeQueue[slot] = {static_cast<int32_t>(atMs), action, value};
+        timeCount++;
+        return true;
+    }
+
+    // Adds a command to run when the encoder arrives at "position"
+    // (from either side). Returns false if the queue is full.
+    auto addAtPosition(int32_t position, ScheduleAction action, int32_t value, int32_t currentPosition,
+                       bool byRun = false) -> bool {
+        if (positionCount >= CAPACITY) {
+            return false;
+        }
+        int slot = positionCount;
+        while (slot > 0 && positionQueue[slot - 1].at > position) {
+            positionQueue[slot] = positionQueue[slot - 1];
+            slot--;
+        }
+        positionQueue[slot] = {position, action, value, byRun};
+        positionCount++;
+        if (position <= currentPosition) {
+            positionSplit++;
+        }
+        return true;
+    }
+
+    // Takes back one command added with addAtPosition() that hasn't run
+    // yet. Returns false if there isn't one like it.
+    auto removeAtPosition(int32_t position, ScheduleAction action) -> bool {
+        for (int slot = 0; slot < positionCount; slot++) {
+            if (positionQueue[slot].at == position && positionQueue[slot].action == action) {
+                for (int i = slot; i < positionCount - 1; i++) {
+                    positionQueue[i] = positionQueue[i + 1];
+                }
+                positionCount--;
+                if (slot < positionSplit) {
+                    positionSplit--;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Call when the position changes without passing through every
+    // step in between (e.g. it gets reset) to find the split again
+    auto setPosition(int32_t position) -> void {
+        positionSplit = 0;
+        while (positionSplit < positionCount && positionQueue[positionSplit].at <= position) {
+            positionSplit++;
+        }
+    }
+
+    // Pops the next command that is due at nowMs, if any
+    // Call it in a loop until it returns false
+    auto popDueTime(uint32_t nowMs, ScheduledCommand& command) -> bool {
+        if (timeCount == 0) {
+            return false;
+        }
+        const ScheduledCommand& next = timeQueue[timeCount - 1];
+        if (static_cast<int32_t>(nowMs - static_cast<uint32_t>(next.at)) < 0) {
+            return false;
+        }
+        command = next;
+        timeCount--;
+        return true;
+    }
+
+    // Pops the next command for the edge that just moved the encoder
+    // to "position", if any. Call it in a loop until it returns false,
+    // with the same "forward" every time: the way that edge went, even if
+    // one of the commands reverses the encoder.
+    auto popAtPosition(int32_t position, bool forward, ScheduledCommand& command) -> bool {
+        int slot = 0;
+        if (forward) {
+            if (positionSplit >= positionCount || positionQueue[positionSplit].at != position) {
+                return false;
+            }
+            slot = positionSplit;
+        } else {
+            // Entries we just moved below are now above us
+            while (positionSplit > 0 && positionQueue[positionSplit - 1].at > position) {
+                positionSplit--;
+            }
+            if (positionSplit == 0 || positionQueue[positionSplit - 1].at != position) {
+                return false;
+            }
+            positionSplit--;
+            slot = positionSplit;
+        }
+        command = positionQueue[slot];
+        for (int i = slot; i < positionCount - 1; i++) {
+            positionQueue[i] = positionQueue[i + 1];
+        }
+        positionCount--;
+        return true;
+    }
+};
+
+// Memory the schedule takes in the app arena (see arena.h)
+constexpr size_t COMMAND_SCHEDULE_ARENA_BYTES = sizeof(CommandSchedule);
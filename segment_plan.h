@@ -0,0 +1,207 @@
+// Compact motion plans: a queue of segments instead of an entry per edge
+//
+// A test plan spelled out edge by edge doesn't fit in 64KB, but most of
+// one is runs of edges at a steady (or steadily changing) rate. A segment
+// is one such run: how many edges, which way, the 1/4 period after its
+// first edge and how much that changes from one edge to the next. A dwell
+// segment stands still for a number of ms instead. A segment is 8 bytes,
+// the whole plan under 150, and with passes that's minutes (or days) of
+// motion. A slope is at most half a ms per edge, a steeper ramp is a few
+// segments.
+//
+// SegmentPlayer turns the plan into edges only as they're needed: every
+// next() gives the direction of the next edge and how long after it the
+// one after comes, with one add per edge (the 1/4 period is kept in
+// 1/256 ms and rounded). Only the timing rounds, every segment makes
+// exactly its number of edges, so where each one ends is known exactly
+// and can be checked against the counter.
+
+#pragma once
+
+#include "text_line.h"
+#include "uart_link.h"
+#include <cstddef>
+#include <cstdint>
+
+enum class SegmentKind : uint8_t {
+    forwards,
+    backwards,
+    dwell, // count is ms standing still
+};
+
+struct MotionSegment {
+    uint32_t count = 0; // edges, or ms for a dwell
+    uint16_t startMs = 1; // 1/4 period after the first edge
+    int8_t slope = 0; // change in the 1/4 period per edge, in 1/256 ms
+    SegmentKind kind = SegmentKind::dwell;
+};
+
+// Longest dwell segment, a longer one is two of them
+const uint32_t PLAN_MAX_DWELL_MS = 3600000;
+
+struct SegmentPlan {
+    static constexpr auto CAPACITY = 16;
+
+    MotionSegment segments[CAPACITY] = {};
+    uint8_t count = 0;
+
+    auto clear() -> void {
+        count = 0;
+    }
+
+    // Appends the segments in "text", all of them or none:
+    //   "F <edges> <start ms> [<slope>]"  forwards
+    //   "B <edges> <start ms> [<slope>]"  backwards
+    //   "D <ms>"  dwell
+    // as many of them on one line as fit, slope is in 1/256 ms per edge
+    auto addText(const char* text) -> bool {
+        const uint8_t before = count;
+        bool ok = true;
+        while (ok) {
+            while (*text == ' ') {
+                text++;
+            }
+            if (*text == '\0') {
+                break;
+            }
+            const char kind = *text++;
+            int64_t length = 0;
+            int64_t startMs = 1;
+            int64_t slope = 0;
+            MotionSegment added;
+            ok = count < CAPACITY && parseInt(text, length) && length >= 1;
+            if (ok && kind == 'D') {
+                ok = length <= PLAN_MAX_DWELL_MS;
+            } else if (ok && (kind == 'F' || kind == 'B')) {
+                ok = length <= INT32_MAX && parseInt(text, startMs) && startMs >= 1 && startMs <= UINT16_MAX;
+                parseInt(text, slope);
+                ok = ok && slope >= INT8_MIN && slope <= INT8_MAX;
+                added.kind = kind == 'F' ? SegmentKind::forwards : SegmentKind::backwards;
+            } else {
+                ok = false;
+            }
+            if (ok) {
+                added.count = static_cast<uint32_t>(length);
+                added.startMs = static_cast<uint16_t>(startMs);
+                added.slope = static_cast<int8_t>(slope);
+                segments[count++] = added;
+            }
+        }
+        if (!ok) {
+            count = before;
+        }
+        return ok;
+    }
+};
+
+// Memory the plan takes in the app arena (see arena.h)
+constexpr size_t SEGMENT_PLAN_ARENA_BYTES = sizeof(SegmentPlan);
+
+struct PlannedEdge {
+    bool forwards = true;
+    // From this edge to the next, with any dwell in between
+    uint32_t gapMs = 0;
+    // Last edge of its segment, the count has to be "target" after it
+    bool segmentEnd = false;
+    int32_t target = 0;
+};
+
+struct SegmentPlayer {
+    // 1/4 period in 1/256 ms, a slope stops at 1ms and at 65535ms
+    static constexpr int32_t RATE_MIN = 1 << 8;
+    static constexpr int32_t RATE_MAX = UINT16_MAX << 8;
+
+    const SegmentPlan* plan = nullptr;
+    uint32_t passes = 1; // times through the plan
+    uint32_t pass = 0;
+    uint8_t index = 0; // segment the next edge is in
+    bool finished = true;
+    uint32_t left = 0; // edges left in it
+    int32_t rateQ8 = RATE_MIN;
+    // Where the count ends up after the segment, modulo 2^32 like the counter
+    int32_t target = 0;
+    // Dwell at the top of the plan, before its first edge
+    uint32_t leadMs = 0;
+
+    // Starts "times" passes through the plan from "position", false if
+    // it has no edges to make
+    auto start(const SegmentPlan& from, uint32_t times, int32_t position) -> bool {
+        plan = &from;
+        passes = times;
+        pass = 0;
+        index = 0;
+        target = position;
+        bool moves = false;
+        for (uint8_t i = 0; i < from.count; i++) {
+            moves = moves || from.segments[i].kind != SegmentKind::dwell;
+        }
+        finished = !moves || times == 0;
+        leadMs = finished ? 0 : enter();
+        return !finished;
+    }
+
+    // The next edge, false once the plan is done
+    auto next(PlannedEdge& edge) -> bool {
+        if (finished) {
+            return false;
+        }
+        const MotionSegment& segment = plan->segments[index];
+        edge.forwards = segment.kind == SegmentKind::forwards;
+        edge.gapMs = static_cast<uint32_t>((rateQ8 + 128) >> 8);
+        const int32_t rate = rateQ8 + segment.slope;
+        rateQ8 = rate < RATE_MIN ? RATE_MIN : rate > RATE_MAX ? RATE_MAX : rate;
+        edge.segmentEnd = --left == 0;
+        edge.target = target;
+        if (edge.segmentEnd) {
+            index++;
+            edge.gapMs += enter();
+        }
+        return true;
+    }
+
+private:
+    // Goes on to the next segment with edges, wrapping round for the next
+    // pass, and returns the ms of dwell on the way
+    auto enter() -> uint32_t {
+        uint32_t dwellMs = 0;
+        while (true) {
+            if (index >= plan->count) {
+                index = 0;
+                if (++pass >= passes) {
+                    finished = true;
+                    return dwellMs;
+                }
+            }
+            const MotionSegment& segment = plan->segments[index];
+            if (segment.kind != SegmentKind::dwell) {
+                left = segment.count;
+                rateQ8 = segment.startMs << 8;
+                const uint32_t edges = segment.kind == SegmentKind::forwards ? segment.count : 0u - segment.count;
+                target = static_cast<int32_t>(static_cast<uint32_t>(target) + edges);
+                return dwellMs;
+            }
+            dwellMs += segment.count;
+            index++;
+        }
+    }
+};
+
+// What came out of playing a plan
+struct PlanTally {
+    uint32_t passes = 0; // asked for
+    uint64_t edges = 0;
+    uint32_t segments = 0; // segments with edges finished
+    uint32_t endErrors = 0; // segments that didn't end exactly on target
+    uint64_t plannedMs = 0; // first edge to last, as planned
+    uint64_t takenMs = 0; // and as it happened
+
+    // Appends the run to an open file:
+    //   "S <ms> <plan segments> <passes> <edges> <segments> <end errors>
+    //      <planned ms> <taken ms>"
+    auto write(int handle, uint32_t startedMs, const SegmentPlan& plan) const -> void {
+        TextLine line;
+        line.put('S').putInt(startedMs).putInt(plan.count).putInt(passes).putInt(static_cast<int64_t>(edges))
+            .putInt(segments).putInt(endErrors).putInt(static_cast<int64_t>(plannedMs))
+            .putInt(static_cast<int64_t>(takenMs)).writeFile(handle);
+    }
+};
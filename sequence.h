@@ -0,0 +1,235 @@
+// Coroutine sequences that wait on the encoder instead of blocking it
+//
+// Things like test routines and LED animations are easiest to write as
+// straight line code ("do this, wait 50ms, do that"), but waitms() stops
+// the encoder for the whole wait. A sequence is a coroutine that waits
+// with co_await instead, and gets resumed by the main loop:
+//
+//   auto blink(Sequencer& seq) -> Sequence {
+//       setBoardLED(0, 255, 0, 0, 100, ledsimplevalue);
+//       co_await seq.after(100); // the encoder keeps running meanwhile
+//       co_await seq.untilPosition(400);
+//       co_await seq.nextEvent(FWGUI_EVENT_YELLOW_BUTTON);
+//   }
+//   blink(sequencer);
+//
+// Every sequence takes the Sequencer as its first argument, its frame is
+// allocated from the Sequencer's fixed pool, never the heap. If the pool is
+// full (or the frame is too big for a slot) the sequence does not start and
+// the returned Sequence says so.
+//
+// The main loop feeds the Sequencer with onEdge() after every edge,
+// onTime() every loop and onEvent() for every GUI event. Sequences only
+// run from those calls, after the pins have already been written.
+
+#pragma once
+
+#include "fwwasm.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+class Sequencer;
+
+// What a suspended sequence is waiting for
+enum class SequenceWaitKind : uint8_t {
+    none,
+    edge, // the next edge, any direction
+    time, // millis() reaching value
+    position, // the tick count being exactly value
+    event, // a GUI event of type value, or any if value is -1
+};
+
+// Returned by every sequence, only says whether it could be started
+// The sequence owns itself, its frame is freed when it finishes
+struct Sequence {
+    struct promise_type {
+        auto get_return_object() -> Sequence {
+            return Sequence{true};
+        }
+        static auto get_return_object_on_allocation_failure() -> Sequence {
+            return Sequence{false};
+        }
+        // Start right away, clean up as soon as the body is done
+        auto initial_suspend() noexcept -> std::suspend_never {
+            return {};
+        }
+        auto final_suspend() noexcept -> std::suspend_never {
+            return {};
+        }
+        auto return_void() -> void {}
+        auto unhandled_exception() -> void {
+            __builtin_trap();
+        }
+
+        // Frames come from the pool of the Sequencer passed as first argument
+        template <typename... Args>
+        static auto operator new(size_t size, Sequencer& sequencer, Args&...) noexcept -> void*;
+        static auto operator delete(void* frame) noexcept -> void;
+    };
+
+    bool started = false;
+};
+
+class Sequencer {
+public:
+    // How many sequences can exist at the same time: one run, a stopped
+    // one still finishing its last wait, and the startup LEDs
+    static constexpr auto SLOTS = 3;
+    // Biggest coroutine frame we take, a sequence with a lot of local
+    // state across co_await won't start (started == false)
+    static constexpr size_t SLOT_BYTES = 256;
+
+    // Awaitable returned by the wait functions below
+    struct Wait {
+        Sequencer& sequencer;
+        SequenceWaitKind kind;
+        int32_t value;
+
+        auto await_ready() const noexcept -> bool {
+            return false;
+        }
+        auto await_suspend(std::coroutine_handle<> handle) noexcept -> void {
+            sequencer.park(handle, kind, value);
+        }
+        auto await_resume() const noexcept -> void {}
+    };
+
+    auto nextEdge() -> Wait {
+        return {*this, SequenceWaitKind::edge, 0};
+    }
+    // millis() wraps, so only wait for times less than 24 days away
+    auto untilTime(uint32_t atMs) -> Wait {
+        return {*this, SequenceWaitKind::time, static_cast<int32_t>(atMs)};
+    }
+    auto after(uint32_t delayMs) -> Wait {
+        return untilTime(millis() + delayMs);
+    }
+    auto untilPosition(int32_t position) -> Wait {
+        return {*this, SequenceWaitKind::position, position};
+    }
+    // -1 waits for any event
+    auto nextEvent(int event) -> Wait {
+        return {*this, SequenceWaitKind::event, event};
+    }
+
+    // Called by the main loop -------------------------------------------
+
+    auto onEdge(int32_t position) -> void {
+        resumeReady([position](const Parked& parked) {
+            return parked.kind == SequenceWaitKind::edge
+                   || (parked.kind == SequenceWaitKind::position && parked.value == position);
+        });
+    }
+
+    auto onTime(uint32_t nowMs) -> void {
+        resumeReady([nowMs](const Parked& parked) {
+            return parked.kind == SequenceWaitKind::time
+                   && static_cast<int32_t>(nowMs - static_cast<uint32_t>(parked.value)) >= 0;
+        });
+    }
+
+    auto onEvent(int event) -> void {
+        resumeReady([event](const Parked& parked) {
+            return parked.kind == SequenceWaitKind::event && (parked.value == -1 || parked.value == event);
+        });
+    }
+
+    // Resumes everything waiting on an edge or a position right away, for
+    // when the encoder was stopped and they would wait forever. A sequence
+    // can't tell this from the real thing, it has to check why it woke.
+    auto wakeMotionWaits() -> void {
+        resumeReady([](const Parked& parked) {
+            return parked.kind == SequenceWaitKind::edge || parked.kind == SequenceWaitKind::position;
+        });
+    }
+
+    // Number of sequences that currently exist
+    auto running() const -> int {
+        int count = 0;
+        for (bool used : slotUsed) {
+            count += used ? 1 : 0;
+        }
+        return count;
+    }
+
+    // Frame pool, used by Sequence::promise_type ------------------------
+
+    auto allocate(size_t size) -> void* {
+        // The owner is stored in front of the frame so operator delete,
+        // which gets no arguments, can find its way back here
+        if (size + FRAME_HEADER > SLOT_BYTES) {
+            return nullptr;
+        }
+        for (int slot = 0; slot < SLOTS; slot++) {
+            if (!slotUsed[slot]) {
+                slotUsed[slot] = true;
+                *reinterpret_cast<Sequencer**>(slots[slot]) = this;
+                return slots[slot] + FRAME_HEADER;
+            }
+        }
+        return nullptr;
+    }
+
+    static auto release(void* frame) -> void {
+        unsigned char* start = static_cast<unsigned char*>(frame) - FRAME_HEADER;
+        Sequencer* owner = *reinterpret_cast<Sequencer**>(start);
+        const auto slot = (start - owner->slots[0]) / static_cast<ptrdiff_t>(SLOT_BYTES);
+        owner->slotUsed[slot] = false;
+    }
+
+private:
+    // Keeps the frames 16 byte aligned
+    static constexpr size_t FRAME_HEADER = 16;
+
+    struct Parked {
+        std::coroutine_handle<> handle;
+        SequenceWaitKind kind = SequenceWaitKind::none;
+        int32_t value = 0;
+    };
+
+    auto park(std::coroutine_handle<> handle, SequenceWaitKind kind, int32_t value) -> void {
+        // Every sequence waits on one thing at a time, so with one
+        // parking spot per frame slot there is always room
+        for (Parked& parked : waiting) {
+            if (parked.kind == SequenceWaitKind::none) {
+                parked = {handle, kind, value};
+                return;
+            }
+        }
+    }
+
+    // Resumes every sequence whose wait is over
+    // The ready ones are collected first, so a sequence that waits
+    // again straight away is not resumed twice by the same call
+    template <typename Ready>
+    auto resumeReady(Ready ready) -> void {
+        std::coroutine_handle<> resume[SLOTS];
+        int count = 0;
+        for (Parked& parked : waiting) {
+            if (parked.kind != SequenceWaitKind::none && ready(parked)) {
+                resume[count++] = parked.handle;
+                parked.kind = SequenceWaitKind::none;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            resume[i].resume();
+        }
+    }
+
+    alignas(16) unsigned char slots[SLOTS][SLOT_BYTES] = {};
+    bool slotUsed[SLOTS] = {};
+    Parked waiting[SLOTS] = {};
+};
+
+template <typename... Args>
+auto Sequence::promise_type::operator new(size_t size, Sequencer& sequencer, Args&...) noexcept -> void* {
+    return sequencer.allocate(size);
+}
+
+inline auto Sequence::promise_type::operator delete(void* frame) noexcept -> void {
+    Sequencer::release(frame);
+}
+
+// Memory the sequencer and its frames take in the app arena (see arena.h)
+constexpr size_t SEQUENCER_ARENA_BYTES = sizeof(Sequencer);
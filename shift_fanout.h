@@ -0,0 +1,77 @@
+// Multi channel encoder outputs through a chain of 74HC595 shift registers
+//
+// The faster alternative to the I2C expanders (expander_fanout.h): all
+// the channels' pins are clocked out in one SPIReadWrite per tick. Each
+// register holds 8 pins, 4 channels, from the multi channel engine's pin
+// mask (multichannel.h); up to 8 registers.
+//
+// The registers' latch (RCLK) is meant to be tied to chip select, so every
+// output moves at the same moment when the transfer ends. fwwasm.h has no
+// chip select control for SPIReadWrite, so that rests on an assumption:
+// that the firmware asserts chip select for exactly one call and releases
+// it at the end. Nothing in the app uses this back end yet, like the
+// multi channel engine it is only built and checked on the host
+// (host/shift_register_bench.cpp).
+//
+// The frame is kept between ticks and only the bytes holding pins that
+// changed are rewritten. The first byte out ends up in the register at
+// the far end of the chain, so pin bit k is in frame byte
+// (registers - 1 - k / 8).
+
+#pragma once
+
+#include "fwwasm.h"
+#include "multichannel.h"
+#include <cstdint>
+
+struct ShiftRegisterFanOut {
+    static constexpr auto CHANNELS_PER_REGISTER = 4;
+    static constexpr auto MAX_REGISTERS = MULTICHANNEL_MAX / CHANNELS_PER_REGISTER;
+
+    int registers = 0;
+    uint64_t pinMask = 0; // pins the chain has room for
+    uint64_t written = 0; // pins in the frame
+    unsigned char frame[MAX_REGISTERS] = {};
+    uint32_t transfers = 0;
+    uint32_t failures = 0;
+
+    // Sets the chain length for "channels" and clears every output
+    auto begin(int channels) -> bool {
+        registers = (channels + CHANNELS_PER_REGISTER - 1) / CHANNELS_PER_REGISTER;
+        if (channels < 1 || registers > MAX_REGISTERS) {
+            registers = 0;
+            return false;
+        }
+        pinMask = registers == MAX_REGISTERS ? ~0ull : (1ull << (registers * 8)) - 1;
+        written = 0;
+        for (unsigned char& byte : frame) {
+            byte = 0;
+        }
+        return send();
+    }
+
+    // Clocks out the pins, always one transfer even if nothing changed,
+    // so every tick takes the same time
+    auto write(uint64_t pins) -> bool {
+        pins &= pinMask;
+        uint64_t changed = pins ^ written;
+        while (changed != 0) {
+            const int byte = __builtin_ctzll(changed) / 8;
+            frame[registers - 1 - byte] = static_cast<unsigned char>(pins >> (byte * 8));
+            changed &= ~(0xFFull << (byte * 8));
+        }
+        written = pins;
+        return send();
+    }
+
+private:
+    auto send() -> bool {
+        unsigned char unused[MAX_REGISTERS];
+        transfers++;
+        if (SPIReadWrite(frame, registers, unused) == 0) {
+            failures++;
+            return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,141 @@
+// Analog sin/cos encoder outputs through a two channel SPI DAC
+//
+// Analog encoders give a sine and a cosine instead of A and B, with some
+// number of signal periods per revolution. The digital engine still does
+// the moving; this turns its position (plus how far it is towards the
+// next edge) into a phase and writes both DAC channels.
+//
+// Samples come from a quarter wave sine table built at compile time, with
+// linear interpolation between entries, so a 12 bit DAC is within about
+// one code of the real sine. Both channels go out in one 4 byte SPI frame,
+// one SPIReadWrite per update. The frame buffer keeps its control bits
+// between updates and only the sample bits are patched in.
+//
+// Frame layout, MCP4922 style 16 bit words:
+//   bit 15 = channel (0 = A/sine, 1 = B/cosine), bit 13 = 1x gain,
+//   bit 12 = output on, bits 11-0 = code
+// The cosine word goes first so in a daisy chained pair of DACs it ends up
+// in the far one. The DAC has to take both words in one chip select (a
+// daisy chain, or a dual DAC that latches on chip select going up).
+//
+// The DUT readback (dut_readback.h) can also use SPI, the two share the bus.
+
+#pragma once
+
+#include "fwwasm.h"
+#include <array>
+#include <cstdint>
+#include <numbers>
+
+// Entries in a quarter of a sine period (there is one more for 90 degrees)
+const int DAC_QUARTER_STEPS = 64;
+// DAC codes, 12 bit
+const int DAC_MID = 2048;
+const int DAC_AMPLITUDE = 1900;
+const uint16_t DAC_WORD_CONFIG = 0x3000; // 1x gain, output on
+const uint16_t DAC_WORD_CHANNEL_B = 0x8000;
+
+// sin(0..90 degrees) scaled to 32767
+// std::sin isn't constexpr yet, the Taylor series is plenty up to pi/2
+constexpr auto buildQuarterSine() -> std::array<uint16_t, DAC_QUARTER_STEPS + 1> {
+    std::array<uint16_t, DAC_QUARTER_STEPS + 1> table{};
+    for (int i = 0; i <= DAC_QUARTER_STEPS; i++) {
+        const double x = std::numbers::pi / 2 * i / DAC_QUARTER_STEPS;
+        double term = x;
+        double sum = x;
+        for (int k = 1; k < 12; k++) {
+            term *= -x * x / ((2 * k) * (2 * k + 1));
+            sum += term;
+        }
+        table[static_cast<size_t>(i)] = static_cast<uint16_t>(sum * 32767 + 0.5);
+    }
+    return table;
+}
+
+constexpr auto QUARTER_SINE = buildQuarterSine();
+
+// Sine of a phase in 1/65536 of a period, scaled to +-32767
+constexpr auto sineQ15(uint16_t phase) -> int32_t {
+    // Distance into the quarter, mirrored on the falling quarters
+    uint32_t within = phase & 0x3FFFu;
+    if (phase & 0x4000u) {
+        within = 0x4000u - within;
+    }
+    const uint32_t index = within >> 8;
+    const uint32_t fraction = within & 0xFFu;
+    int32_t value = QUARTER_SINE[index];
+    if (index < DAC_QUARTER_STEPS) {
+        value += ((QUARTER_SINE[index + 1] - value) * static_cast<int32_t>(fraction)) >> 8;
+    }
+    return (phase & 0x8000u) ? -value : value;
+}
+
+struct SinCosDac {
+    uint32_t periodsPerRev = 0; // 0 = off
+    uint32_t edgesPerRev = 4;
+    uint32_t updateMs = 1;
+
+    uint32_t nextUpdateMs = 0;
+    uint32_t updates = 0;
+    uint32_t failures = 0;
+    unsigned char frame[4] = {};
+
+    auto configure(uint32_t periods, uint32_t edges, uint32_t everyMs) -> void {
+        periodsPerRev = periods;
+        edgesPerRev = edges == 0 ? 1 : edges;
+        updateMs = everyMs == 0 ? 1 : everyMs;
+        putWord(0, static_cast<uint16_t>(DAC_WORD_CHANNEL_B | DAC_WORD_CONFIG | DAC_MID));
+        putWord(2, static_cast<uint16_t>(DAC_WORD_CONFIG | DAC_MID));
+    }
+
+    auto enabled() const -> bool {
+        return periodsPerRev != 0;
+    }
+
+    auto due(uint32_t nowMs) const -> bool {
+        return enabled() && static_cast<int32_t>(nowMs - nextUpdateMs) >= 0;
+    }
+
+    // Phase for a position, "towardsNext" (0 to 65535) of the way to the
+    // next edge in direction "forward"
+    auto phaseAt(int32_t position, uint32_t towardsNext, bool forward) const -> uint16_t {
+        // The phase repeats every revolution, so only the position within
+        // one matters, and keeping it there stops a long run's count from
+        // overflowing once it's scaled by 65536 periods
+        const auto edges = static_cast<int64_t>(edgesPerRev);
+        const int64_t within = ((static_cast<int64_t>(position) % edges) + edges) % edges;
+        const int64_t edgesQ16 = within * 65536 + (forward ? 1 : -1) * static_cast<int64_t>(towardsNext);
+        const int64_t scaled = edgesQ16 * periodsPerRev;
+        // Round down, not towards zero, so going back past 0 stays smooth
+        const int64_t phase = scaled >= 0 ? scaled / edges : -((-scaled + edges - 1) / edges);
+        return static_cast<uint16_t>(phase & 0xFFFF);
+    }
+
+    // Writes both channels for this phase
+    auto update(uint32_t nowMs, uint16_t phase) -> void {
+        nextUpdateMs = nowMs + updateMs;
+        patchCode(0, code(static_cast<uint16_t>(phase + 0x4000u)));
+        patchCode(2, code(phase));
+        unsigned char unused[4];
+        if (SPIReadWrite(frame, static_cast<int>(sizeof(frame)), unused) == 0) {
+            failures++;
+            return;
+        }
+        updates++;
+    }
+
+    static auto code(uint16_t phase) -> uint16_t {
+        return static_cast<uint16_t>(DAC_MID + ((DAC_AMPLITUDE * sineQ15(phase) + (1 << 14)) >> 15));
+    }
+
+private:
+    auto putWord(int at, uint16_t word) -> void {
+        frame[at] = static_cast<unsigned char>(word >> 8);
+        frame[at + 1] = static_cast<unsigned char>(word);
+    }
+
+    auto patchCode(int at, uint16_t value) -> void {
+        frame[at] = static_cast<unsigned char>((frame[at] & 0xF0u) | (value >> 8));
+        frame[at + 1] = static_cast<unsigned char>(value);
+    }
+};
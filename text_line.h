@@ -0,0 +1,71 @@
+// Builds one line of ASCII text without printf
+// Used for everything we send to the PC over the UART (see uart_link.h)
+// and for the text files we leave on the Free-Wili.
+
+#pragma once
+
+#include "fwwasm.h"
+#include <cstdint>
+
+// Longest line we accept or send, anything longer is dropped
+const auto TEXT_LINE_MAX = 64;
+
+// File modes for openFile, same flags as FatFS underneath
+const int FILE_MODE_READ = 0x01; // read, has to exist
+const int FILE_MODE_WRITE_NEW = 0x0A; // write, create or truncate
+const int FILE_MODE_APPEND = 0x32; // write, create or open at the end
+
+struct TextLine {
+    unsigned char buffer[TEXT_LINE_MAX] = {0};
+    int length = 0;
+
+    auto put(char c) -> TextLine& {
+        if (length < TEXT_LINE_MAX - 1) {
+            buffer[length++] = static_cast<unsigned char>(c);
+        }
+        return *this;
+    }
+
+    // Decimal number preceded by a space
+    auto putInt(int64_t value) -> TextLine& {
+        put(' ');
+        uint64_t magnitude = static_cast<uint64_t>(value);
+        if (value < 0) {
+            put('-');
+            magnitude = ~magnitude + 1;
+        }
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        while (count > 0) {
+            put(digits[--count]);
+        }
+        return *this;
+    }
+
+    // Word preceded by a space, used for names and placeholders like "-"
+    auto putWord(const char* word) -> TextLine& {
+        put(' ');
+        while (*word != '\0') {
+            put(*word++);
+        }
+        return *this;
+    }
+
+    // Terminates the line and sends it with a single UARTDataWrite
+    auto sendUart() -> void {
+        buffer[length++] = '\n';
+        UARTDataWrite(buffer, length);
+        length = 0;
+    }
+
+    // Terminates the line and writes it to an open file
+    auto writeFile(int handle) -> void {
+        buffer[length++] = '\n';
+        ::writeFile(handle, buffer, length);
+        length = 0;
+    }
+};
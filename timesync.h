@@ -0,0 +1,188 @@
+// Estimates how the Free-Wili millis() clock lines up with the test PC clock
+// so the telemetry we send can be stamped in PC time.
+//
+// The exchange is a simple ping/pong over the UART (see uart_link.h):
+//   device -> PC : "P <seq> <deviceMs>"
+//   PC -> device : "O <seq> <pcMicros>"
+// The PC stamps its reply with its own clock in microseconds. Assuming the
+// reply was stamped halfway through the round trip, the offset between the
+// clocks is pcMicros - (send + receive) / 2. Only the sample with the
+// smallest round trip in a window is trusted, since long round trips
+// are the ones that got stuck somewhere (USB polling, the PC scheduler...).
+//
+// Drift is the slope of the offset between the best sample of an older
+// window and the best sample of the newest window.
+
+#pragma once
+
+#include "uart_link.h"
+#include <cstddef>
+#include <cstdint>
+
+struct TimeSyncSample {
+    uint64_t deviceMidUs = 0; // device time halfway through the round trip
+    int64_t offsetUs = 0; // pc time minus device time
+    uint32_t rttUs = 0; // round trip time
+};
+
+struct TimeSync {
+    // How many round trips are kept for min-RTT filtering
+    static constexpr auto WINDOW = 4;
+    // How often to ping the PC
+    static constexpr uint32_t PING_PERIOD_MS = 1000;
+    // Pongs that take longer than this are considered lost
+    static constexpr uint32_t PING_TIMEOUT_MS = 500;
+    // Shortest and longest baseline used to measure drift
+    static constexpr uint64_t MIN_DRIFT_SPAN_US = 30000000;
+    static constexpr uint64_t MAX_DRIFT_SPAN_US = 600000000;
+    // Worst case drift of the crystal before we measured it, in parts per
+    // million. A measured drift is only used once it's known better.
+    static constexpr int64_t UNKNOWN_DRIFT_PPM = 100;
+    // How far off a millis() reading can be from the real time
+    static constexpr int64_t MILLIS_RESOLUTION_US = 1000;
+
+    // millis() wraps every 49.7 days, keep a 64 bit version of it
+    uint32_t lastMillis = 0;
+    uint64_t millisHigh = 0;
+
+    uint32_t pingSeq = 0;
+    uint64_t pingSentMs = 0;
+    uint64_t nextPingMs = 0;
+    bool pingOutstanding = false;
+
+    TimeSyncSample window[WINDOW] = {};
+    uint8_t windowCount = 0; // samples in the window so far
+    uint8_t windowNext = 0; // where the next sample goes
+    uint8_t epochCount = 0; // samples since the last drift update
+
+    bool synced = false;
+    TimeSyncSample best; // min RTT sample of the current window
+    bool haveAnchor = false;
+    TimeSyncSample anchor; // older sample used as the drift baseline
+    bool haveDrift = false;
+    int64_t driftPpb = 0; // PC clock speed relative to ours, parts per billion
+    int64_t driftErrorPpb = 0; // how far off driftPpb can be
+
+    // Extends a millis() reading to 64 bits, must be called with
+    // readings that never go backwards
+    auto extendMillis(uint32_t nowMs) -> uint64_t {
+        if (nowMs < lastMillis) {
+            millisHigh += 1ull << 32;
+        }
+        lastMillis = nowMs;
+        return millisHigh | nowMs;
+    }
+
+    // Sends a ping if it is time to. Call this every loop.
+    auto pollPing(uint32_t nowMs) -> void {
+        const uint64_t now = extendMillis(nowMs);
+        if (pingOutstanding && now - pingSentMs > PING_TIMEOUT_MS) {
+            pingOutstanding = false;
+        }
+        if (pingOutstanding || now < nextPingMs) {
+            return;
+        }
+        pingSeq++;
+        pingSentMs = now;
+        nextPingMs = now + PING_PERIOD_MS;
+        pingOutstanding = true;
+        TextLine frame;
+        frame.put('P').putInt(pingSeq).putInt(nowMs).sendUart();
+    }
+
+    // Handles a line received from the UART
+    // Returns true if it was a pong and has been consumed
+    auto handleLine(const char* line, uint32_t nowMs) -> bool {
+        if (line[0] != 'O') {
+            return false;
+        }
+        const uint64_t now = extendMillis(nowMs);
+        const char* cursor = line + 1;
+        int64_t seq = 0;
+        int64_t pcUs = 0;
+        if (!parseInt(cursor, seq) || !parseInt(cursor, pcUs)) {
+            return true;
+        }
+        // Late or duplicated replies are ignored, their round trip is unknown
+        if (!pingOutstanding || static_cast<uint32_t>(seq) != pingSeq) {
+            return true;
+        }
+        pingOutstanding = false;
+
+        TimeSyncSample sample;
+        sample.deviceMidUs = (pingSentMs + now) * 500;
+        sample.offsetUs = pcUs - static_cast<int64_t>(sample.deviceMidUs);
+        sample.rttUs = static_cast<uint32_t>((now - pingSentMs) * 1000);
+        addSample(sample);
+        return true;
+    }
+
+    auto addSample(const TimeSyncSample& sample) -> void {
+        window[windowNext] = sample;
+        windowNext = static_cast<uint8_t>((windowNext + 1) % WINDOW);
+        if (windowCount < WINDOW) {
+            windowCount++;
+        }
+
+        // Min-RTT filter over the window
+        best = window[0];
+        for (int i = 1; i < windowCount; i++) {
+            if (window[i].rttUs < best.rttUs) {
+                best = window[i];
+            }
+        }
+        synced = true;
+
+        // Once per full window, use its best sample to update the drift
+        epochCount++;
+        if (epochCount < WINDOW) {
+            return;
+        }
+        epochCount = 0;
+        if (!haveAnchor) {
+            anchor = best;
+            haveAnchor = true;
+            return;
+        }
+        const uint64_t span = best.deviceMidUs - anchor.deviceMidUs;
+        if (span < MIN_DRIFT_SPAN_US) {
+            return;
+        }
+        // Each offset can be off by half its round trip and a millis()
+        // step, over a short span that's a lot of ppm. Until the estimate
+        // is better than not knowing, the last one (or none) stays.
+        const int64_t offsetErrorUs = (anchor.rttUs + best.rttUs) / 2 + 2 * MILLIS_RESOLUTION_US;
+        const int64_t errorPpb = offsetErrorUs * 1000000000 / static_cast<int64_t>(span);
+        if (errorPpb < UNKNOWN_DRIFT_PPM * 1000) {
+            driftPpb = (best.offsetUs - anchor.offsetUs) * 1000000000 / static_cast<int64_t>(span);
+            driftErrorPpb = errorPpb;
+            haveDrift = true;
+        }
+        // Slide the baseline forward so temperature changes are followed
+        if (span > MAX_DRIFT_SPAN_US) {
+            anchor = best;
+        }
+    }
+
+    // Converts a millis() reading to PC time in microseconds
+    // Returns false if we have not heard from the PC yet
+    auto pcMicros(uint32_t nowMs, int64_t& pcUs, uint32_t& uncertaintyUs) -> bool {
+        if (!synced) {
+            return false;
+        }
+        const int64_t deviceUs = static_cast<int64_t>(extendMillis(nowMs) * 1000);
+        const int64_t elapsedUs = deviceUs - static_cast<int64_t>(best.deviceMidUs);
+        pcUs = deviceUs + best.offsetUs + (haveDrift ? driftPpb * elapsedUs / 1000000000 : 0);
+
+        // Half the round trip, plus the resolution of millis(), plus
+        // whatever the drift (or what we got wrong about it) could have
+        // added since the sample
+        const int64_t driftError = (haveDrift ? driftErrorPpb : UNKNOWN_DRIFT_PPM * 1000)
+                                   * (elapsedUs < 0 ? -elapsedUs : elapsedUs) / 1000000000;
+        uncertaintyUs = static_cast<uint32_t>(best.rttUs / 2 + MILLIS_RESOLUTION_US + driftError);
+        return true;
+    }
+};
+
+// Memory the time sync takes in the app arena (see arena.h)
+constexpr size_t TIME_SYNC_ARENA_BYTES = sizeof(TimeSync);
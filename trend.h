@@ -0,0 +1,77 @@
+// Velocity and position over time, decimated for a plot
+//
+// The pin plot shows every level change, which is unreadable for a long
+// profile or sweep. This gives a fixed number of points per second no
+// matter how fast the encoder goes, so a plot fed from it costs a bounded
+// number of host calls.
+//
+// The velocity comes from the edge timestamps: the ticks between the last
+// edge before this point and the last edge before the previous point,
+// over the time between those two edges. That is the rate the engine
+// really made, without the error of counting edges in a window that
+// doesn't line up with them.
+
+#pragma once
+
+#include <cstdint>
+
+struct TrendDecimator {
+    uint32_t periodMs = 100; // time between points
+    uint32_t nextPointMs = 0;
+
+    // Last edge seen, and the one the previous point's velocity ended at
+    int32_t lastPosition = 0;
+    uint32_t lastEdgeMs = 0;
+    uint32_t edgeGapMs = 0; // between the last two edges
+    int32_t anchorPosition = 0;
+    uint32_t anchorMs = 0;
+    bool haveAnchor = false;
+
+    int32_t velocity = 0; // edges per second, signed
+
+    auto setPointsPerSecond(uint32_t points) -> void {
+        periodMs = 1000 / (points == 0 ? 1 : points);
+    }
+
+    // Called for every edge, with the position after it
+    auto edge(uint32_t nowMs, int32_t position) -> void {
+        edgeGapMs = nowMs - lastEdgeMs;
+        lastPosition = position;
+        lastEdgeMs = nowMs;
+        if (!haveAnchor) {
+            haveAnchor = true;
+            anchorPosition = position;
+            anchorMs = nowMs;
+        }
+    }
+
+    // The position jumped without edges (a preset), don't count the jump
+    auto restart() -> void {
+        haveAnchor = false;
+    }
+
+    // True when it's time for the next point, velocity is then up to date
+    auto point(uint32_t nowMs) -> bool {
+        if (static_cast<int32_t>(nowMs - nextPointMs) < 0) {
+            return false;
+        }
+        nextPointMs = nowMs + periodMs;
+        // Stopped (or nearly) when no edge came for a point, and for
+        // twice as long as the edges were apart
+        const uint32_t quietMs = nowMs - lastEdgeMs;
+        const bool stopped = quietMs > periodMs && quietMs > 2 * edgeGapMs;
+        if (haveAnchor && lastEdgeMs != anchorMs) {
+            const auto spanMs = static_cast<int64_t>(lastEdgeMs - anchorMs);
+            velocity = static_cast<int32_t>((static_cast<int64_t>(lastPosition) - anchorPosition) * 1000 / spanMs);
+            anchorPosition = lastPosition;
+            anchorMs = lastEdgeMs;
+        } else if (stopped) {
+            velocity = 0;
+        }
+        // Don't let a long stop count as a slow move later
+        if (stopped) {
+            haveAnchor = false;
+        }
+        return true;
+    }
+};
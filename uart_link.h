@@ -0,0 +1,73 @@
+// Small helpers to talk to the test PC over the Free-Wili UART
+// Everything on the wire is plain ASCII, one message per line,
+// so it can be read with any serial terminal while debugging.
+// The first character of every line says what kind of message it is,
+// followed by space separated decimal numbers.
+
+#pragma once
+
+#include "fwwasm.h"
+#include "text_line.h"
+#include <cstdint>
+
+// Collects incoming UART bytes until a full line is available
+// Lines longer than TEXT_LINE_MAX are thrown away entirely
+struct UartLineReader {
+    char line[TEXT_LINE_MAX] = {0};
+    uint8_t length = 0;
+    bool overflow = false;
+
+    // Reads whatever is waiting in the UART and returns true once
+    // a complete line is stored in "line" (without the newline)
+    // Only reads one byte at a time so we never swallow the next line
+    auto poll() -> bool {
+        while (UARTDataRxCount() > 0) {
+            unsigned char byte = 0;
+            if (UARTDataRead(&byte, 1) != 1) {
+                return false;
+            }
+            if (byte == '\r') {
+                continue;
+            }
+            if (byte == '\n') {
+                const bool complete = !overflow && length > 0;
+                line[complete ? length : 0] = '\0';
+                length = 0;
+                overflow = false;
+                if (complete) {
+                    return true;
+                }
+                continue;
+            }
+            if (length >= TEXT_LINE_MAX - 1) {
+                overflow = true;
+                continue;
+            }
+            line[length++] = static_cast<char>(byte);
+        }
+        return false;
+    }
+};
+
+// Reads the next space separated decimal number from "text"
+// and moves "text" past it. Returns false if there is no number.
+inline auto parseInt(const char*& text, int64_t& value) -> bool {
+    while (*text == ' ') {
+        text++;
+    }
+    bool negative = false;
+    if (*text == '-') {
+        negative = true;
+        text++;
+    }
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    int64_t result = 0;
+    while (*text >= '0' && *text <= '9') {
+        result = result * 10 + (*text - '0');
+        text++;
+    }
+    value = negative ? -result : result;
+    return true;
+}